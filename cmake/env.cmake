@@ -19,3 +19,9 @@ LIST(APPEND stdgl_libraries ${OPENGL_gl_LIBRARY})
 if (APPLE)
 	FIND_LIBRARY(COCOA_LIBRARY Cocoa REQUIRED)
 endif(APPLE)
+
+# Precision
+OPTION(RAY_FLOAT "Trace in single precision instead of double (see src/scene/real.h)" OFF)
+IF (RAY_FLOAT)
+	ADD_DEFINITIONS(-DRAY_FLOAT)
+ENDIF (RAY_FLOAT)
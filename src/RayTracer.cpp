@@ -6,12 +6,17 @@
 #include "scene/light.h"
 #include "scene/material.h"
 #include "scene/ray.h"
+#include "scene/scene.h"
+#include "scene/bvh.h"
+#include "scene/sceneCache.h"
 
 #include "parser/Tokenizer.h"
 #include "parser/Parser.h"
+#include "fileio/mappedfile.h"
 
 #include "ui/TraceUI.h"
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
 #include <glm/glm.hpp>
 #include <string.h> // for memset
@@ -19,6 +24,7 @@
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <chrono>
 
 using namespace std;
 extern TraceUI* traceUI;
@@ -30,34 +36,39 @@ extern TraceUI* traceUI;
 // in TraceGLWindow, for example.
 bool debugMode = false;
 
-double eps = 0.000001;
+// offset that starts secondary rays clear of the surface they leave
+#ifdef RAY_FLOAT
+real eps = 0.0001;
+#else
+real eps = 0.000001;
+#endif
 
 // Trace a top-level ray through pixel(i,j), i.e. normalized window coordinates (x,y),
 // through the projection plane, and out into the scene.  All we do is
 // enter the main ray-tracing method, getting things started by plugging
-// in an initial ray weight of (0.0,0.0,0.0) and an initial recursion depth of 0.
+// in an initial ray weight of (1.0,1.0,1.0) and the maximum recursion depth.
 
-glm::dvec3 RayTracer::trace(double x, double y, unsigned char *pixel, unsigned int ctr)
+rvec3 RayTracer::trace(real x, real y, unsigned char *pixel, unsigned int ctr)
 {
     // Clear out the ray cache in the scene for debugging purposes,
   if (TraceUI::m_debug) scene->intersectCache.clear();
 
-    ray r(glm::dvec3(0,0,0), glm::dvec3(0,0,0), pixel, ctr, glm::dvec3(1,1,1), ray::VISIBILITY);
+    ray r(rvec3(0,0,0), rvec3(0,0,0), pixel, ctr, rvec3(1,1,1), ray::VISIBILITY);
     scene->getCamera().rayThrough(x,y,r);
-    double dummy;
-    glm::dvec3 ret = traceRay(r, glm::dvec3(1.0,1.0,1.0), traceUI->getDepth() , dummy);
-    ret = glm::clamp(ret, 0.0, 1.0);
+    real dummy;
+    rvec3 ret = traceRay(r, rvec3(traceUI->getWeightThreshold()), traceUI->getDepth() , dummy);
+    ret = glm::clamp(ret, real(0.0), real(1.0));
     return ret;
 }
 
-glm::dvec3 RayTracer::tracePixel(int i, int j, unsigned int ctr)
+rvec3 RayTracer::tracePixel(int i, int j, unsigned int ctr)
 {
-	glm::dvec3 col(0,0,0);
+	rvec3 col(0,0,0);
 
 	if( ! sceneLoaded() ) return col;
 
-	double x = double(i)/double(buffer_width);
-	double y = double(j)/double(buffer_height);
+	real x = real(i)/real(buffer_width);
+	real y = real(j)/real(buffer_height);
 
 	unsigned char *pixel = buffer + ( i + j * buffer_width ) * 3;
 	col = trace(x, y, pixel, ctr);
@@ -68,18 +79,69 @@ glm::dvec3 RayTracer::tracePixel(int i, int j, unsigned int ctr)
 	return col;
 }
 
+// Trace the w x h pixels at (x0, y0), w * h <= BVH::MAX_PACKET, as one
+// packet: their primary rays are intersected together, then each hit is
+// shaded, and its secondary rays traced, on its own.
+void RayTracer::tracePacket(int x0, int y0, int w, int h, unsigned int ctr, std::vector<ray>& rays)
+{
+	rays.clear();
+	for(int y = y0; y < y0 + h; y++)
+		for(int x = x0; x < x0 + w; x++) {
+			unsigned char *pixel = buffer + ( x + y * buffer_width ) * 3;
+			rays.push_back(ray(rvec3(0,0,0), rvec3(0,0,0), pixel, ctr, rvec3(1,1,1), ray::VISIBILITY));
+			scene->getCamera().rayThrough(real(x)/real(buffer_width), real(y)/real(buffer_height), rays.back());
+		}
+
+	isect hits[BVH::MAX_PACKET];
+	bool found[BVH::MAX_PACKET];
+	scene->intersect(&rays[0], w * h, hits, found);
+	for(int k = 0; k < w * h; k++) {
+		real dummy;
+		rvec3 col = shadeHit(rays[k], hits[k], found[k], rvec3(traceUI->getWeightThreshold()), traceUI->getDepth(), dummy);
+		setPixel(x0 + k % w, y0 + k / w, glm::clamp(col, real(0.0), real(1.0)));
+	}
+}
+
+// Is any channel of the ray weight w above the cutoff?
+static bool visible(const rvec3& w, const rvec3& thresh)
+{
+    return w[0] > thresh[0] || w[1] > thresh[1] || w[2] > thresh[2];
+}
 
 // Do recursive ray tracing!  You'll want to insert a lot of code here
 // (or places called from here) to handle reflection, refraction, etc etc.
-glm::dvec3 RayTracer::traceRay(ray& r, const glm::dvec3& thresh, int depth, double& t )
+rvec3 RayTracer::traceRay(ray& r, const rvec3& thresh, int depth, real& t )
 {
 	isect i;
-	glm::dvec3 colorC;
+	bool hit = scene->intersect(r, i);
+	return shadeHit(r, i, hit, thresh, depth, t);
+}
 
-	if(scene->intersect(r, i)) {
-        glm::dvec3 reflectedColor(0.0, 0.0, 0.0);
-        glm::dvec3 refractedColor(0.0, 0.0, 0.0);
-        Material mat = i.getMaterial();
+rvec3 RayTracer::shadeHit(ray& r, const isect& i, bool hit, const rvec3& thresh, int depth, real& t )
+{
+	rvec3 colorC;
+
+	if(hit) {
+        rvec3 reflectedColor(0.0, 0.0, 0.0);
+        rvec3 refractedColor(0.0, 0.0, 0.0);
+        // mat may be per-thread scratch space (blended trimesh materials)
+        // that the recursive calls below reuse, so everything needed from
+        // it is taken up front.
+        const Material& mat = i.getMaterial();
+        rvec3 kr = mat.kr(i);
+        rvec3 kt = mat.kt(i);
+        bool refl = mat.Refl();
+        bool trans = mat.Trans();
+        real index = mat.index(i);
+        rvec3 refAtten = r.getAtten() * kr;
+        rvec3 transAtten = r.getAtten() * kt;
+
+        if(debugMode) {
+            std::cout << "Ks: (" << mat.ks(i).x << ", " << mat.ks(i).y << ", " << mat.ks(i).z << ")" << std::endl;
+            std::cout << "Translucent:  " << (trans ? "true" : "false") << std::endl;
+            std::cout << "Reflective:  " << (refl ? "true" : "false") << std::endl;
+        }
+        colorC = mat.shade(scene, r, i);
 
         if(depth > 0) {
 
@@ -87,64 +149,68 @@ glm::dvec3 RayTracer::traceRay(ray& r, const glm::dvec3& thresh, int depth, doub
                 std::cout << "DEPTH " << depth << std::endl;
 
             // Reflection
-            if(mat.Refl()) {
-                glm::dvec3 ref = glm::normalize(r.getDirection() - 2.0 * glm::dot(i.N, r.getDirection()) * i.N);
-                ray refRay(r.getPosition() + i.t * r.getDirection() + ref * eps, ref, r.getPixel(), r.ctr, r.getAtten(),
+            if(refl && visible(refAtten, thresh)) {
+                rvec3 ref = glm::normalize(r.getDirection() - real(2.0) * glm::dot(i.N, r.getDirection()) * i.N);
+                ray refRay(r.getPosition() + i.t * r.getDirection() + ref * eps, ref, r.getPixel(), r.ctr, refAtten,
                            ray::REFLECTION);
                 reflectedColor = traceRay(refRay, thresh, depth - 1, t);
             }
 
 
             // Refraction
-            glm::dvec3 n = i.N;
-            glm::dvec3 d = -r.getDirection();
-            double c = glm::dot(n, d);
-            double n1 = (c < 0 ? i.getMaterial().index(i) : 1);
-            double n2 = (c < 0 ? 1 : i.getMaterial().index(i));
-            double rConst = n1 / n2;
-            double radical = 1 - rConst * rConst * (1 - c * c);
-
-            if(debugMode) {
-                std::cout << "Ks: (" << mat.ks(i).x << ", " << mat.ks(i).y << ", " << mat.ks(i).z << ")" << std::endl;
-                std::cout << "Translucent:  " << (mat.Trans() ? "true" : "false") << std::endl;
-                std::cout << "Reflective:  " << (mat.Refl() ? "true" : "false") << std::endl;
+            rvec3 n = i.N;
+            rvec3 d = -r.getDirection();
+            real c = glm::dot(n, d);
+            real n1 = (c < 0 ? index : 1);
+            real n2 = (c < 0 ? 1 : index);
+            real rConst = n1 / n2;
+            real radical = 1 - rConst * rConst * (1 - c * c);
+
+            if(debugMode)
                 std::cout << "Radical: " << radical << std::endl;
-            }
 
 
-            if (radical >= 0 && mat.Trans()) {
+            if (radical >= 0 && trans && visible(transAtten, thresh)) {
                 if(debugMode)
                     std::cout << "NO TOTAL INTERNAL REFRACTION " << std::endl;
 
                 // For exiting rays, c < 0, so we have to use c*-1
-                glm::dvec3 altN = n;
+                rvec3 altN = n;
                 if(c < 0)
                     altN = -altN;
 
-                glm::dvec3 T = glm::normalize(-(rConst * d + sqrt(radical) * altN));
-                ray refractedRay(r.getPosition() + (i.t + eps) * r.getDirection(), T, r.getPixel(), r.ctr, r.getAtten(),
+                rvec3 T = glm::normalize(-(rConst * d + sqrt(radical) * altN));
+                ray refractedRay(r.getPosition() + (i.t + eps) * r.getDirection(), T, r.getPixel(), r.ctr, transAtten,
                                  ray::REFRACTION);
                 refractedColor = traceRay(refractedRay, thresh, depth - 1, t);
             }
         }
 
-		colorC = mat.shade(scene, r, i) + mat.kr(i)*reflectedColor + mat.kt(i)*refractedColor;
+		colorC += kr*reflectedColor + kt*refractedColor;
 	} else {
         if(haveCubeMap())
 		    colorC = getCubeMap()->getColor(r);
         else
-            colorC = glm::dvec3(0, 0, 0);
+            colorC = rvec3(0, 0, 0);
 	}
 	return colorC;
 }
 
 RayTracer::RayTracer()
-	: scene(0), buffer(0), thresh(0), buffer_width(256), buffer_height(256), m_bBufferReady(false), cubemap (0)
+	: pool(std::max(std::thread::hardware_concurrency(), 1u)),
+	  jobsRunning(0), tilesDone(0), tilesTotal(0), stopTrace(false), packetWidth(1), packetHeight(1),
+	  buffer(0), buffer_width(256), buffer_height(256), bufferSize(0),
+	  threads(std::max(std::thread::hardware_concurrency(), 1u)),
+	  blockSize(1), thresh(0), aaThresh(0), samples(0),
+	  scene(0), cubemap(0), m_bBufferReady(false)
 {
 }
 
 RayTracer::~RayTracer()
 {
+	// let a render in progress wind down before the scene goes away
+	requestStop();
+	pool.wait();
 	delete scene;
 	delete [] buffer;
 }
@@ -175,13 +241,31 @@ bool RayTracer::loadScene( char* fn ) {
 	if( path.find_last_of( "\\/" ) == string::npos ) path = ".";
 	else path = path.substr(0, path.find_last_of( "\\/" ));
 
-	// Call this with 'true' for debug output from the tokenizer
-	Tokenizer tokenizer( ifs, false );
-	Parser parser( tokenizer, path );
+	// A compiled copy of the scene saved by an earlier run is used as long
+	// as it matches the scene file and the mesh files the scene reads.
+	bool useCache = traceUI->sceneCacheSw();
+	string cachePath = SceneCache::pathFor( fn );
+	uint64_t sourceHash = 0;
+	if( useCache ) {
+		MappedFile source;
+		useCache = source.open( fn );
+		if( useCache ) sourceHash = SceneCache::hash( source.data(), source.size() );
+	}
+
 	try {
 		delete scene;
 		scene = 0;
-		scene = parser.parseScene();
+		if( useCache ) scene = SceneCache::read( cachePath, path, sourceHash, &pool );
+		if( !scene ) {
+			// Call this with 'true' for debug output from the tokenizer
+			Tokenizer tokenizer( ifs, false );
+			Parser parser( tokenizer, path, &pool );
+			scene = parser.parseScene();
+			// not being able to write the cache (say, a read-only
+			// directory) only costs the next run the parse
+			if( useCache )
+				SceneCache::write( cachePath, path, *scene, sourceHash, parser.dependencies() );
+		}
 	} 
 	catch( SyntaxErrorException& pe ) {
 		traceUI->alert( pe.formattedMessage() );
@@ -222,130 +306,303 @@ void RayTracer::traceSetup(int w, int h)
 
 void RayTracer::traceImage(int w, int h, int bs, double thresh)
 {
+    // the buffer and the BVH are about to change under any pass still running
+    waitRender();
     traceSetup(w, h);
+    blockSize = bs;
+    this->thresh = thresh;
+
+    // packets of 4, 8 or 16 rays are 2x2, 4x2 or 4x4 pixels
+    int packet = traceUI->getPacketSize();
+    packetWidth = packet >= 8 ? 4 : packet >= 4 ? 2 : 1;
+    packetHeight = packet >= 16 ? 4 : packet >= 4 ? 2 : 1;
+
+    // The kd-tree is optional; otherwise the top-level BVH is used.
+    if(traceUI->kdSwitch())
+        scene->buildKdTree(traceUI->getMaxDepth(), traceUI->getLeafSize());
+    else {
+        scene->clearKdTree();
+        scene->buildBVH();
+    }
 
-    int size = w*h;
-    threadList.clear();
-    threadDone.clear();
-    threadRayRange.clear();
+    startTiles(&RayTracer::traceTile);
+}
 
-    for(unsigned int i = 0; i < threads; i++) {
-        std::pair<int, int>range (i* size / threads, (i+1) * size / threads);
-        if(i == threads - 1)
-            range.second = size;
+int RayTracer::aaImage(int samples, double aaThresh)
+{
+    waitRender();
+    this->samples = std::max(samples, 1);
+    this->aaThresh = aaThresh;
+
+    // Mark the pixels on edges in the traced image.  This is done up front
+    // so the render jobs never look at pixels another job is rewriting.
+    int limit = (int)(aaThresh * 255.0);
+    int marked = 0;
+    aaMask.assign(buffer_width * buffer_height, 0);
+    for(int y = 0; y < buffer_height; y++)
+        for(int x = 0; x < buffer_width; x++) {
+            const unsigned char *pixel = buffer + (x + y * buffer_width) * 3;
+            bool edge = false;
+            for(int ny = std::max(y - 1, 0); ny <= std::min(y + 1, buffer_height - 1) && !edge; ny++)
+                for(int nx = std::max(x - 1, 0); nx <= std::min(x + 1, buffer_width - 1) && !edge; nx++) {
+                    const unsigned char *other = buffer + (nx + ny * buffer_width) * 3;
+                    for(int c = 0; c < 3; c++)
+                        if(std::abs(pixel[c] - other[c]) > limit)
+                            edge = true;
+                }
+            if(edge) {
+                aaMask[x + y * buffer_width] = 1;
+                marked++;
+            }
+        }
 
-        threadDone.push_back(false);
-        threadRayRange.push_back(range);
-        threadList.push_back(thread(&RayTracer::traceThread, this, i));
-    }
+    sampleGrids.resize(std::max(1u, std::min(pool.size(), (unsigned int)MAX_THREADS)));
+    startTiles(&RayTracer::aaTile);
+    return marked;
 }
 
-void RayTracer::traceThread(unsigned int threadIdx) {
-    std::pair<int, int> range = this->threadRayRange[threadIdx];
-
-    for(int i = range.first; i < range.second; i++) {
-        int x = i / buffer_width;
-        int y = i % buffer_width;
+// Queue the tiles of the image and submit one render job per pool worker.
+// Only the previous pass is waited for; other jobs on the pool, such as
+// texture decodes, carry on alongside the render.
+void RayTracer::startTiles(TileWork work)
+{
+    waitRender();
+    tileQueues.clear();
+    stopTrace.store(false, std::memory_order_relaxed);
+
+    std::vector<Tile> tiles;
+    for(int y = 0; y < buffer_height; y += tileSize)
+        for(int x = 0; x < buffer_width; x += tileSize) {
+            Tile tile = { x, y, std::min(x + tileSize, buffer_width), std::min(y + tileSize, buffer_height) };
+            tiles.push_back(tile);
+        }
 
-        tracePixel(x, y, threadIdx);
+    unsigned int count = std::max(1u, std::min(pool.size(), (unsigned int)MAX_THREADS));
+    for(unsigned int i = 0; i < count; i++) {
+        tileQueues.push_back(std::unique_ptr<TileQueue>(new TileQueue));
+        tileQueues[i]->tiles.assign(tiles.begin() + i * tiles.size() / count,
+                                    tiles.begin() + (i + 1) * tiles.size() / count);
     }
-
-    threadDone[threadIdx] = true;
+    {
+        std::lock_guard<std::mutex> guard(renderLock);
+        jobsRunning = count;
+    }
+    tilesDone = 0;
+    tilesTotal = (int)tiles.size();
+    for(unsigned int i = 0; i < count; i++)
+        pool.submit(std::bind(&RayTracer::tileThread, this, i, work));
 }
 
-int RayTracer::aaImage(int samples, double aaThresh)
+// Take the next tile from this thread's own queue, or steal the last tile
+// of the next thread that still has work.
+bool RayTracer::nextTile(unsigned int threadIdx, Tile& tile)
 {
-    int size = buffer_width*buffer_height;
-    aaThreadList.clear();
-    aaThreadDone.clear();
-    aaThreadRayRange.clear();
-
-    for(unsigned int i = 0; i < threads; i++) {
-        std::pair<int, int>range (i* size / threads, (i+1) * size / threads);
-        if(i == threads - 1)
-            range.second = size;
-
-        aaThreadDone.push_back(false);
-        aaThreadRayRange.push_back(range);
-        aaThreadList.push_back(thread(&RayTracer::aaImageThread, this, i, samples));
+    TileQueue& own = *tileQueues[threadIdx];
+    {
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tiles.empty()) {
+            tile = own.tiles.front();
+            own.tiles.pop_front();
+            return true;
+        }
     }
+    for(size_t k = 1; k < tileQueues.size(); k++) {
+        TileQueue& victim = *tileQueues[(threadIdx + k) % tileQueues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tiles.empty()) {
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
 }
 
-void RayTracer::aaImageThread(unsigned int threadIdx, int samples) {
-    std::pair<int, int> range = this->aaThreadRayRange[threadIdx];
-
-    for(int i = range.first; i < range.second; i++) {
-        int x = i / buffer_width;
-        int y = i % buffer_width;
-
-        SampleMap oversampleMap;
-        getSamples(x, y, samples, oversampleMap);
-        glm::dvec3 color = getAverageColor(x, y, samples, oversampleMap);
-        setPixel(x, y, color);
+void RayTracer::tileThread(unsigned int threadIdx, TileWork work)
+{
+    Tile tile;
+    while(!stopRequested() && nextTile(threadIdx, tile)) {
+        (this->*work)(tile, threadIdx);
+        int done = ++tilesDone;
+        if(progress)
+            progress(done, tilesTotal);
     }
 
-    aaThreadDone[threadIdx] = true;
+    std::lock_guard<std::mutex> guard(renderLock);
+    if(--jobsRunning == 0)
+        renderDone.notify_all();
 }
 
-// This method gets (sampleLevel + 1)^2 additional samples within the pixel (x,y) pixel.
-void RayTracer::getSamples(int x, int y, int sampleLevel, SampleMap& oversampleMap) {
-    for(int i = 0; i <= sampleLevel; i++) {
-        for(int j = 0; j <= sampleLevel; j++) {
-            double xSample = (double)x - 0.5 + (double)i/sampleLevel;
-            double ySample = (double)y - 0.5 + (double)j/sampleLevel;
-
-            // Check if sample exists already. If not, compute
-            if(oversampleMap.find({xSample, ySample}) == oversampleMap.end()) {
-
-                double xNormal = xSample / buffer_width;
-                double yNormal = ySample / buffer_height;
-
-                glm::dvec3 color(0, 0, 0);
-
-                unsigned char pixel[3] = {0, 0, 0};
-                color = trace(xNormal, yNormal, pixel, 0);
-
-                // Isn't C++11 beautiful?
-                oversampleMap[{xSample, ySample}] = color;
-            }
+void RayTracer::traceTile(const Tile& tile, unsigned int threadIdx)
+{
+    // a tile one pixel wide or high has nothing to interpolate
+    bool thin = tile.x1 - tile.x0 < 2 || tile.y1 - tile.y0 < 2;
+    if(blockSize <= 1 || thresh <= 0.0 || thin) {
+        if(packetWidth * packetHeight <= 1 || TraceUI::m_debug) {
+            for(int y = tile.y0; y < tile.y1; y++)
+                for(int x = tile.x0; x < tile.x1; x++)
+                    tracePixel(x, y, threadIdx);
+            return;
         }
+        // packets are clipped to the tile at its right and bottom edges
+        std::vector<ray> rays;
+        rays.reserve(BVH::MAX_PACKET);
+        for(int y = tile.y0; y < tile.y1; y += packetHeight)
+            for(int x = tile.x0; x < tile.x1; x += packetWidth)
+                tracePacket(x, y, std::min(packetWidth, tile.x1 - x), std::min(packetHeight, tile.y1 - y),
+                            threadIdx, rays);
+        return;
     }
-}
 
-// This function gets all oversamples in the function and computes an average
-glm::dvec3 RayTracer::getAverageColor(int x, int y, int sampleLevel, SampleMap& oversampleMap) {
-    glm::dvec3 color(0, 0, 0);
+    // Block corners: every blockSize-th pixel of the tile, plus its last
+    // row and column.  Neighbouring blocks share their corners.
+    int xs[tileSize + 1], ys[tileSize + 1];
+    int nx = 0, ny = 0;
+    for(int x = tile.x0; x < tile.x1 - 1; x += blockSize)
+        xs[nx++] = x;
+    xs[nx++] = tile.x1 - 1;
+    for(int y = tile.y0; y < tile.y1 - 1; y += blockSize)
+        ys[ny++] = y;
+    ys[ny++] = tile.y1 - 1;
+
+    rvec3 corners[(tileSize + 1) * (tileSize + 1)];
+    for(int b = 0; b < ny; b++)
+        for(int a = 0; a < nx; a++)
+            corners[a + b * nx] = tracePixel(xs[a], ys[b], threadIdx);
+
+    // Each block fills the pixels from its top left corner up to, but not
+    // including, the next corners; the last row and column of blocks also
+    // take the tile's last row and column.
+    for(int b = 0; b + 1 < ny; b++)
+        for(int a = 0; a + 1 < nx; a++) {
+            const rvec3& c00 = corners[a + b * nx];
+            const rvec3& c10 = corners[a + 1 + b * nx];
+            const rvec3& c01 = corners[a + (b + 1) * nx];
+            const rvec3& c11 = corners[a + 1 + (b + 1) * nx];
+            rvec3 lo = glm::min(glm::min(c00, c10), glm::min(c01, c11));
+            rvec3 hi = glm::max(glm::max(c00, c10), glm::max(c01, c11));
+            rvec3 spread = hi - lo;
+            bool smooth = spread[0] <= thresh && spread[1] <= thresh && spread[2] <= thresh;
+
+            int xEnd = a + 2 == nx ? xs[a + 1] : xs[a + 1] - 1;
+            int yEnd = b + 2 == ny ? ys[b + 1] : ys[b + 1] - 1;
+            real w = xs[a + 1] - xs[a];
+            real h = ys[b + 1] - ys[b];
+            for(int y = ys[b]; y <= yEnd; y++)
+                for(int x = xs[a]; x <= xEnd; x++) {
+                    bool cornerX = x == xs[a] || x == xs[a + 1];
+                    bool cornerY = y == ys[b] || y == ys[b + 1];
+                    if(cornerX && cornerY)
+                        continue;
+                    if(!smooth) {
+                        tracePixel(x, y, threadIdx);
+                        continue;
+                    }
+                    real fx = (x - xs[a]) / w;
+                    real fy = (y - ys[b]) / h;
+                    setPixel(x, y, (1 - fy) * ((1 - fx) * c00 + fx * c10) +
+                                   fy * ((1 - fx) * c01 + fx * c11));
+                }
+        }
+}
 
-    for(int i = 0; i <= sampleLevel; i++) {
-        for(int j = 0; j <= sampleLevel; j++) {
-            double xSample = (double) x - 0.5 + (double) i / sampleLevel;
-            double ySample = (double) y - 0.5 + (double) j / sampleLevel;
+void RayTracer::aaTile(const Tile& tile, unsigned int threadIdx)
+{
+    SampleGrid& grid = sampleGrids[threadIdx];
+    grid.x0 = tile.x0;
+    grid.y0 = tile.y0;
+    grid.samples = samples;
+    grid.ctr = threadIdx;
+    grid.width = (tile.x1 - tile.x0) * samples + 1;
+    grid.height = (tile.y1 - tile.y0) * samples + 1;
+    grid.colors.resize(grid.width * grid.height);
+    grid.traced.assign(grid.width * grid.height, 0);
+
+    for(int y = tile.y0; y < tile.y1; y++)
+        for(int x = tile.x0; x < tile.x1; x++) {
+            if(!aaMask[x + y * buffer_width])
+                continue;
+            int gx = (x - tile.x0) * samples;
+            int gy = (y - tile.y0) * samples;
+            setPixel(x, y, adaptiveSample(grid, gx, gy, gx + samples, gy + samples));
+        }
+}
 
-            color += oversampleMap[{xSample, ySample}] / pow(sampleLevel + 1, 2);
+// Lattice point (gx, gy) of the grid.  Point i of pixel x lies at
+// x - 0.5 + i/samples, so the last point of one pixel is the first of the
+// next.
+rvec3 RayTracer::getSample(SampleGrid& grid, int gx, int gy) {
+    int k = gx + gy * grid.width;
+    if(grid.traced[k])
+        return grid.colors[k];
+
+    real xSample = (real)(grid.x0 + gx / grid.samples) - 0.5 + (real)(gx % grid.samples) / grid.samples;
+    real ySample = (real)(grid.y0 + gy / grid.samples) - 0.5 + (real)(gy % grid.samples) / grid.samples;
+
+    unsigned char pixel[3] = {0, 0, 0};
+    grid.colors[k] = trace(xSample / buffer_width, ySample / buffer_height, pixel, grid.ctr);
+    grid.traced[k] = 1;
+    return grid.colors[k];
+}
 
-            if (oversampleMap[{xSample, ySample}] != glm::dvec3(0, 0, 0)) {
-                glm::dvec3 clr = oversampleMap[{xSample, ySample}] / pow(sampleLevel + 1, 2);
-            }
+// Average color over the lattice cells [i0, i1] x [j0, j1].  The corners
+// are traced first; the region is only split further, down to single
+// lattice cells, while they disagree by more than aaThresh.
+rvec3 RayTracer::adaptiveSample(SampleGrid& grid, int i0, int j0, int i1, int j1) {
+    rvec3 c00 = getSample(grid, i0, j0);
+    rvec3 c10 = getSample(grid, i1, j0);
+    rvec3 c01 = getSample(grid, i0, j1);
+    rvec3 c11 = getSample(grid, i1, j1);
+
+    rvec3 lo = glm::min(glm::min(c00, c10), glm::min(c01, c11));
+    rvec3 hi = glm::max(glm::max(c00, c10), glm::max(c01, c11));
+    rvec3 spread = hi - lo;
+    bool smooth = spread[0] <= aaThresh && spread[1] <= aaThresh && spread[2] <= aaThresh;
+    if(smooth || (i1 - i0 <= 1 && j1 - j0 <= 1))
+        return (c00 + c10 + c01 + c11) * real(0.25);
+
+    // split the longer side(s) in half and weight the parts by area
+    int im = i1 - i0 > 1 ? (i0 + i1) / 2 : i1;
+    int jm = j1 - j0 > 1 ? (j0 + j1) / 2 : j1;
+    real area = (real)(i1 - i0) * (j1 - j0);
+    rvec3 color(0, 0, 0);
+    int is[3] = { i0, im, i1 };
+    int js[3] = { j0, jm, j1 };
+    for(int a = 0; a < 2; a++)
+        for(int b = 0; b < 2; b++) {
+            if(is[a] == is[a + 1] || js[b] == js[b + 1])
+                continue;
+            real weight = (real)(is[a + 1] - is[a]) * (js[b + 1] - js[b]) / area;
+            color += weight * adaptiveSample(grid, is[a], js[b], is[a + 1], js[b + 1]);
         }
-    }
     return color;
 }
 
 bool RayTracer::checkRender()
 {
-	for(auto it = threadDone.begin(); it != threadDone.end(); ++it)
-        if(!(*it))
-            return false;
-	return true;
+	std::lock_guard<std::mutex> guard(renderLock);
+	return jobsRunning == 0;
+}
+
+void RayTracer::waitRender()
+{
+	std::unique_lock<std::mutex> held(renderLock);
+	renderDone.wait(held, [this] { return jobsRunning == 0; });
+}
+
+bool RayTracer::waitRender(int ms)
+{
+	std::unique_lock<std::mutex> held(renderLock);
+	return renderDone.wait_for(held, std::chrono::milliseconds(ms), [this] { return jobsRunning == 0; });
 }
 
-glm::dvec3 RayTracer::getPixel(int i, int j)
+rvec3 RayTracer::getPixel(int i, int j)
 {
 	unsigned char *pixel = buffer + ( i + j * buffer_width ) * 3;
-	return glm::dvec3((double)pixel[0]/255.0, (double)pixel[1]/255.0, (double)pixel[2]/255.0);
+	return rvec3((real)pixel[0]/255.0, (real)pixel[1]/255.0, (real)pixel[2]/255.0);
 }
 
-void RayTracer::setPixel(int i, int j, glm::dvec3 color)
+void RayTracer::setPixel(int i, int j, rvec3 color)
 {
 	unsigned char *pixel = buffer + ( i + j * buffer_width ) * 3;
 
@@ -7,16 +7,22 @@
 
 #include "scene/ray.h"
 #include "scene/cubeMap.h"
+#include "ThreadPool.h"
 #include <time.h>
 #include <thread>
 #include <queue>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include <glm/vec3.hpp>
-#include <unordered_map>
-#include <boost/functional/hash.hpp>
 #include <thread>
 
 
-typedef std::unordered_map<std::pair<double, double>, glm::dvec3, boost::hash< std::pair<double, double> > > SampleMap;
 
 class Scene;
 class Pixel
@@ -36,33 +42,75 @@ public:
 
     ~RayTracer();
 
-    glm::dvec3 tracePixel(int i, int j, unsigned int ctr);
+    rvec3 tracePixel(int i, int j, unsigned int ctr);
 
-    glm::dvec3 trace(double x, double y, unsigned char *pixel, unsigned int ctr);
+    rvec3 trace(real x, real y, unsigned char *pixel, unsigned int ctr);
 
-    glm::dvec3 traceRay(ray &r, const glm::dvec3 &thresh, int depth, double &length);
+    // Trace r and return its color.  Reflected and refracted rays carry the
+    // product of the kr/kt weights along their path in their atten; they
+    // are only traced while that weight exceeds thresh in some channel.
+    rvec3 traceRay(ray &r, const rvec3 &thresh, int depth, real &length);
 
-    glm::dvec3 getPixel(int i, int j);
+    // traceRay() for a ray whose intersection i (if hit) is already known.
+    rvec3 shadeHit(ray &r, const isect &i, bool hit, const rvec3 &thresh, int depth, real &length);
 
-    void setPixel(int i, int j, glm::dvec3 color);
+    rvec3 getPixel(int i, int j);
+
+    void setPixel(int i, int j, rvec3 color);
 
     void getBuffer(unsigned char *&buf, int &w, int &h);
 
     double aspectRatio();
 
+    // Trace the whole image.  With bs > 1 and thresh > 0 this is a draft
+    // mode: only the corners of each bs x bs block are traced, and the
+    // pixels between them are interpolated unless the corners differ by more
+    // than thresh (in any channel, on a 0-1 scale), in which case they are
+    // traced as well.  Otherwise every pixel is traced.
     void traceImage(int w, int h, int bs, double thresh);
 
+    // Anti-alias the traced image.  Only pixels that differ from one of
+    // their eight neighbours by more than aaThresh (in any channel, on a 0-1
+    // scale) are supersampled, down to a (samples+1)^2 lattice within the
+    // pixel where the detail needs it.  Returns the number of pixels that
+    // will be supersampled.
     int aaImage(int samples, double aaThresh);
 
+    // Has the last traceImage() or aaImage() pass finished?  Never blocks.
     bool checkRender();
 
+    // Block until the current pass has finished.
+    void waitRender();
+
+    // Block for at most ms milliseconds; returns true if the pass finished.
+    bool waitRender(int ms);
+
+    // Ask the current pass to stop once its render jobs finish the tiles
+    // they are on, so that waitRender() returns soon.  Safe to call from
+    // any thread; the next traceImage() or aaImage() clears it.
+    void requestStop() { stopTrace.store(true, std::memory_order_relaxed); }
+    bool stopRequested() const { return stopTrace.load(std::memory_order_relaxed); }
+
+    // Called with (tiles finished, total tiles) after every tile of a pass.
+    // It runs on the render threads, so it must be thread safe and quick.
+    // Only set it between passes.
+    typedef std::function<void(int, int)> ProgressCallback;
+    void setProgressCallback(const ProgressCallback &cb) { progress = cb; }
+
     void traceSetup(int w, int h);
 
     void setThreshold(double th) { thresh = th; }
 
     void setaaThreshold(double th) { aaThresh = th; }
 
-    void setThreads(int th) { threads = (unsigned) th; }
+    void setThreads(int th) {
+        threads = (unsigned) std::max(th, 1);
+        pool.resize(threads);
+    }
+
+    // The workers that run render passes, also available for other
+    // parallel work between renders.
+    ThreadPool &getThreadPool() { return pool; }
 
     void setSamples(int num) { samples = num; }
 
@@ -86,27 +134,74 @@ public:
     CubeMap *getCubeMap() { return cubemap; }
 
 private:
-    void getSamples(int x, int y, int sampleLevel, SampleMap &oversampleMap);
-
-    glm::dvec3 getAverageColor(int x, int y, int sampleLevel, SampleMap &oversampleMap);
-
-    std::vector<std::thread> threadList;
-    std::vector<bool> threadDone;
-    std::vector<std::pair<int, int>> threadRayRange;
-
-
-    std::vector<std::thread> aaThreadList;
-    std::vector<bool> aaThreadDone;
-    std::vector<std::pair<int, int>> aaThreadRayRange;
-
-    void traceThread(unsigned int threadIdx);
-	void aaImageThread(unsigned int threadIdx, int samples);
+    // Supersamples of one tile on a dense lattice of samples+1 points per
+    // pixel side, where the points on a pixel's border are shared with its
+    // neighbours.  Points are traced on first use.
+    struct SampleGrid {
+        int x0, y0;          // tile origin in pixels
+        int width, height;   // lattice points per row and column
+        int samples;
+        unsigned int ctr;    // render job tracing into the grid
+        std::vector<rvec3> colors;
+        std::vector<char> traced;
+    };
+
+    rvec3 getSample(SampleGrid &grid, int gx, int gy);
+
+    rvec3 adaptiveSample(SampleGrid &grid, int i0, int j0, int i1, int j1);
+
+    // The image is cut into tileSize x tileSize tiles.  Every render job
+    // on the pool starts with a contiguous run of them in its own queue,
+    // works through it from the front and, once it runs dry, steals from
+    // the back of another job's queue, so the jobs finish together however
+    // the work is spread over the image.
+    static const int tileSize = 16;
+
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
+
+    struct TileQueue {
+        std::mutex lock;
+        std::deque<Tile> tiles;
+    };
+
+    typedef void (RayTracer::*TileWork)(const Tile& tile, unsigned int threadIdx);
+
+    void startTiles(TileWork work);
+    bool nextTile(unsigned int threadIdx, Tile& tile);
+    void tileThread(unsigned int threadIdx, TileWork work);
+    void traceTile(const Tile& tile, unsigned int threadIdx);
+    void aaTile(const Tile& tile, unsigned int threadIdx);
+    void tracePacket(int x0, int y0, int w, int h, unsigned int ctr, std::vector<ray>& rays);
+
+    ThreadPool pool;
+    std::vector<std::unique_ptr<TileQueue>> tileQueues;
+
+    // pixels picked for supersampling by aaImage()
+    std::vector<char> aaMask;
+    // one sample lattice per render job, reused from tile to tile
+    std::vector<SampleGrid> sampleGrids;
+
+    // completion of the current pass
+    std::mutex renderLock;
+    std::condition_variable renderDone;
+    int jobsRunning;
+    std::atomic<int> tilesDone;
+    int tilesTotal;
+    std::atomic<bool> stopTrace;
+    ProgressCallback progress;
+
+    // pixels per primary ray packet in full traces, from the UI's
+    // packet size; 1 x 1 traces pixel by pixel
+    int packetWidth, packetHeight;
 
 public:
 	unsigned char *buffer;
 	int buffer_width, buffer_height;
 	int bufferSize;
 	unsigned int threads;
+	int blockSize;
 	double thresh;
 	double aaThresh;
 	int samples;
@@ -114,7 +209,6 @@ public:
 	CubeMap* cubemap;
 
 	bool m_bBufferReady;
-	bool stopTrace;
 
 };
 
@@ -6,19 +6,17 @@
 
 using namespace std;
 
-const double HUGE_DOUBLE = 1e100;
-
-bool Box::intersectLocal(ray& r, isect& i) const
+bool Box::intersectLocal(const ray& r, isect& i) const
 {
-        glm::dvec3 p = r.getPosition();
-        glm::dvec3 d = r.getDirection();
+        rvec3 p = r.getPosition();
+        rvec3 d = r.getDirection();
 //        d.normalize();
 
         int it;
-        double x, y, t, bestT; 
+        real x, y, t, bestT; 
         int mod0, mod1, mod2, bestIndex;
 
-        bestT = HUGE_DOUBLE;
+        bestT = REAL_MAX;
         bestIndex = -1;
 
         for(it=0; it<6; it++){ 
@@ -56,22 +54,22 @@ bool Box::intersectLocal(ray& r, isect& i) const
         i.setObject(this);
 		i.setMaterial(this->getMaterial());
 
-		//glm::dvec3 intersect_point = r.at((float)i.t);
-		glm::dvec3 intersect_point = r.at(i.t);
+		//rvec3 intersect_point = r.at((float)i.t);
+		rvec3 intersect_point = r.at(i.t);
 
 		int i1 = (bestIndex + 1) % 3;
 		int i2 = (bestIndex + 2) % 3;
 
         if(bestIndex < 3)
 		{
-                i.setN(glm::dvec3(-double(bestIndex == 0), -double(bestIndex == 1), -double(bestIndex == 2)));
-				i.setUVCoordinates( glm::dvec2(	0.5 - intersect_point[ min(i1, i2) ], 
+                i.setN(rvec3(-real(bestIndex == 0), -real(bestIndex == 1), -real(bestIndex == 2)));
+				i.setUVCoordinates( rvec2(	0.5 - intersect_point[ min(i1, i2) ], 
 											0.5 + intersect_point[ max(i1, i2) ] ) );
 		}
         else
 		{
-                i.setN(glm::dvec3(double(bestIndex==3), double(bestIndex == 4), double(bestIndex == 5)));
-				i.setUVCoordinates( glm::dvec2(	0.5 + intersect_point[ min(i1, i2) ],
+                i.setN(rvec3(real(bestIndex==3), real(bestIndex == 4), real(bestIndex == 5)));
+				i.setUVCoordinates( rvec2(	0.5 + intersect_point[ min(i1, i2) ],
 											0.5 + intersect_point[ max(i1, i2) ] ) );
 
 		}
@@ -10,14 +10,14 @@ public:
 	{
 	}
 
-	virtual bool intersectLocal(ray& r, isect& i ) const;
+	virtual bool intersectLocal(const ray& r, isect& i ) const;
 	virtual bool hasBoundingBoxCapability() const { return true; }
 
     virtual BoundingBox ComputeLocalBoundingBox()
     {
         BoundingBox localbounds;
-        localbounds.setMax(glm::dvec3(0.5, 0.5, 0.5));
-		localbounds.setMin(glm::dvec3(-0.5, -0.5, -0.5));
+        localbounds.setMax(rvec3(0.5, 0.5, 0.5));
+		localbounds.setMin(rvec3(-0.5, -0.5, -0.5));
         return localbounds;
     }
 
@@ -8,7 +8,7 @@ class Cone
 {
 public:
 	Cone( Scene *scene, Material *mat, 
-			double h = 1.0, double br = 1.0, double tr = 0.0, 
+			real h = 1.0, real br = 1.0, real tr = 0.0, 
 			bool cap = false )
 		: MaterialSceneObject( scene, mat )
 	{
@@ -36,16 +36,16 @@ public:
 
 	}
 
-	virtual bool intersectLocal(ray& r, isect& i ) const;
+	virtual bool intersectLocal(const ray& r, isect& i ) const;
 	virtual bool hasBoundingBoxCapability() const { return true; }
 
     virtual BoundingBox ComputeLocalBoundingBox()
     {
         BoundingBox localbounds;
-		double biggest_radius = (b_radius > t_radius)?(b_radius):(t_radius);
+		real biggest_radius = (b_radius > t_radius)?(b_radius):(t_radius);
 
-		localbounds.setMin(glm::dvec3(-biggest_radius, -biggest_radius, (height < 0.0f)?(height):(0.0f)));
-		localbounds.setMax(glm::dvec3(biggest_radius, biggest_radius, (height < 0.0f)?(0.0f):(height)));
+		localbounds.setMin(rvec3(-biggest_radius, -biggest_radius, (height < 0.0f)?(height):(0.0f)));
+		localbounds.setMax(rvec3(biggest_radius, biggest_radius, (height < 0.0f)?(0.0f):(height)));
         return localbounds;
     }
 
@@ -53,16 +53,18 @@ public:
 	bool intersectCaps( const ray& r, isect& i ) const;
 
 protected:
-	bool isGoodRoot(glm::dvec3 root) const;
-	double radiusAt(double h) const;
+	friend class SceneCache;
+
+	bool isGoodRoot(rvec3 root) const;
+	real radiusAt(real h) const;
     
 	bool capped;
-	double height;
-	double b_radius;
-	double t_radius;
+	real height;
+	real b_radius;
+	real t_radius;
 
-	double beta, beta_squared;
-	double gamma, gamma_squared;
+	real beta, beta_squared;
+	real gamma, gamma_squared;
 
 protected:
 	void glDrawLocal(int quality, bool actualMaterials, bool actualTextures) const;
@@ -5,7 +5,7 @@
 using namespace std;
 
 
-bool Cylinder::intersectLocal(ray& r, isect& i) const
+bool Cylinder::intersectLocal(const ray& r, isect& i) const
 {
 	i.obj = this;
 	i.setMaterial(this->getMaterial());
@@ -27,14 +27,14 @@ bool Cylinder::intersectLocal(ray& r, isect& i) const
 
 bool Cylinder::intersectBody( const ray& r, isect& i ) const
 {
-	double x0 = r.getPosition()[0];
-	double y0 = r.getPosition()[1];
-	double x1 = r.getDirection()[0];
-	double y1 = r.getDirection()[1];
+	real x0 = r.getPosition()[0];
+	real y0 = r.getPosition()[1];
+	real x1 = r.getDirection()[0];
+	real y1 = r.getDirection()[1];
 
-	double a = x1*x1+y1*y1;
-	double b = 2.0*(x0*x1 + y0*y1);
-	double c = x0*x0 + y0*y0 - 1.0;
+	real a = x1*x1+y1*y1;
+	real b = 2.0*(x0*x1 + y0*y1);
+	real c = x0*x0 + y0*y0 - 1.0;
 
 	if( 0.0 == a ) {
 		// This implies that x1 = 0.0 and y1 = 0.0, which further
@@ -43,7 +43,7 @@ bool Cylinder::intersectBody( const ray& r, isect& i ) const
 		return false;
 	}
 
-	double discriminant = b*b - 4.0*a*c;
+	real discriminant = b*b - 4.0*a*c;
 
 	if( discriminant < 0.0 ) {
 		return false;
@@ -51,32 +51,32 @@ bool Cylinder::intersectBody( const ray& r, isect& i ) const
 	
 	discriminant = sqrt( discriminant );
 
-	double t2 = (-b + discriminant) / (2.0 * a);
+	real t2 = (-b + discriminant) / (2.0 * a);
 
 	if( t2 <= RAY_EPSILON ) {
 		return false;
 	}
 
-	double t1 = (-b - discriminant) / (2.0 * a);
+	real t1 = (-b - discriminant) / (2.0 * a);
 
 	if( t1 > RAY_EPSILON ) {
 		// Two intersections.
-		glm::dvec3 P = r.at( t1 );
-		double z = P[2];
+		rvec3 P = r.at( t1 );
+		real z = P[2];
 		if( z >= 0.0 && z <= 1.0 ) {
 			// It's okay.
 			i.t = t1;
-			i.N = glm::normalize(glm::dvec3( P[0], P[1], 0.0 ));
+			i.N = glm::normalize(rvec3( P[0], P[1], 0.0 ));
 			return true;
 		}
 	}
 
-	glm::dvec3 P = r.at( t2 );
-	double z = P[2];
+	rvec3 P = r.at( t2 );
+	real z = P[2];
 	if( z >= 0.0 && z <= 1.0 ) {
 		i.t = t2;
 
-		glm::dvec3 normal( P[0], P[1], 0.0 );
+		rvec3 normal( P[0], P[1], 0.0 );
 		// In case we are _inside_ the _uncapped_ cone, we need to flip the normal.
 		// Essentially, the cone in this case is a double-sided surface
 		// and has _2_ normals
@@ -96,15 +96,15 @@ bool Cylinder::intersectCaps( const ray& r, isect& i ) const
 		return false;
 	}
 
-	double pz = r.getPosition()[2];
-	double dz = r.getDirection()[2];
+	real pz = r.getPosition()[2];
+	real dz = r.getDirection()[2];
 
 	if( 0.0 == dz ) {
 		return false;
 	}
 
-	double t1;
-	double t2;
+	real t1;
+	real t2;
 
 	if( dz > 0.0 ) {
 		t1 = (-pz)/dz;
@@ -119,27 +119,27 @@ bool Cylinder::intersectCaps( const ray& r, isect& i ) const
 	}
 
 	if( t1 >= RAY_EPSILON ) {
-		glm::dvec3 p( r.at( t1 ) );
+		rvec3 p( r.at( t1 ) );
 		if( (p[0]*p[0] + p[1]*p[1]) <= 1.0 ) {
 			i.t = t1;
 			if( dz > 0.0 ) {
 				// Intersection with cap at z = 0.
-				i.N = glm::dvec3( 0.0, 0.0, -1.0 );
+				i.N = rvec3( 0.0, 0.0, -1.0 );
 			} else {
-				i.N = glm::dvec3( 0.0, 0.0, 1.0 );
+				i.N = rvec3( 0.0, 0.0, 1.0 );
 			}
 			return true;
 		}
 	}
 
-	glm::dvec3 p( r.at( t2 ) );
+	rvec3 p( r.at( t2 ) );
 	if( (p[0]*p[0] + p[1]*p[1]) <= 1.0 ) {
 		i.t = t2;
 		if( dz > 0.0 ) {
 			// Intersection with interior of cap at z = 1.
-			i.N = glm::dvec3( 0.0, 0.0, 1.0 );
+			i.N = rvec3( 0.0, 0.0, 1.0 );
 		} else {
-			i.N = glm::dvec3( 0.0, 0.0, -1.0 );
+			i.N = rvec3( 0.0, 0.0, -1.0 );
 		}
 		return true;
 	}
@@ -12,14 +12,14 @@ public:
 	{
 	}
 
-	virtual bool intersectLocal(ray& r, isect& i ) const;
+	virtual bool intersectLocal(const ray& r, isect& i ) const;
 	virtual bool hasBoundingBoxCapability() const { return true; }
 
     virtual BoundingBox ComputeLocalBoundingBox()
     {
         BoundingBox localbounds;
-		localbounds.setMin(glm::dvec3(-1.0f, -1.0f, 0.0f));
-		localbounds.setMax(glm::dvec3(1.0f, 1.0f, 1.0f));
+		localbounds.setMin(rvec3(-1.0f, -1.0f, 0.0f));
+		localbounds.setMax(rvec3(1.0f, 1.0f, 1.0f));
         return localbounds;
     }
 
@@ -27,6 +27,8 @@ public:
 	bool intersectCaps( const ray& r, isect& i ) const;
 
 protected:
+	friend class SceneCache;
+
 	bool capped;
 
 protected:
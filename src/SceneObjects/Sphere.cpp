@@ -6,19 +6,19 @@
 
 using namespace std;
 
-bool Sphere::intersectLocal(ray& r, isect& i) const
+bool Sphere::intersectLocal(const ray& r, isect& i) const
 {
-	r.d = glm::normalize(r.d);
-	glm::dvec3 v = -r.getPosition();
-	double b = glm::dot(v, r.getDirection());
-	double discriminant = b*b - glm::dot(v,v) + 1;
+	// Geometry::intersect() hands us a normalized direction
+	rvec3 v = -r.getPosition();
+	real b = glm::dot(v, r.getDirection());
+	real discriminant = b*b - glm::dot(v,v) + 1;
 	
 	if( discriminant < 0.0 ) {
 		return false;
 	}
 
 	discriminant = sqrt( discriminant );
-	double t2 = b + discriminant;
+	real t2 = b + discriminant;
 
 	if( t2 <= RAY_EPSILON ) {
 		return false;
@@ -27,7 +27,7 @@ bool Sphere::intersectLocal(ray& r, isect& i) const
 	i.obj = this;
 	i.setMaterial(this->getMaterial());
 
-	double t1 = b - discriminant;
+	real t1 = b - discriminant;
 
 	if( t1 > RAY_EPSILON ) {
 		i.t = t1;
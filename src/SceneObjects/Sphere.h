@@ -12,14 +12,14 @@ public:
 	{
 	}
     
-	virtual bool intersectLocal(ray& r, isect& i ) const;
+	virtual bool intersectLocal(const ray& r, isect& i ) const;
 	virtual bool hasBoundingBoxCapability() const { return true; }
 
     virtual BoundingBox ComputeLocalBoundingBox()
     {
         BoundingBox localbounds;
-		localbounds.setMin(glm::dvec3(-1.0f, -1.0f, -1.0f));
-		localbounds.setMax(glm::dvec3(1.0f, 1.0f, 1.0f));
+		localbounds.setMin(rvec3(-1.0f, -1.0f, -1.0f));
+		localbounds.setMax(rvec3(1.0f, 1.0f, 1.0f));
         return localbounds;
     }
 
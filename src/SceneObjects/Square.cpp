@@ -6,22 +6,22 @@ using namespace std;
 
 
 //Test
-bool Square::intersectLocal(ray& r, isect& i) const
+bool Square::intersectLocal(const ray& r, isect& i) const
 {
-	glm::dvec3 p = r.getPosition();
-	glm::dvec3 d = r.getDirection();
+	rvec3 p = r.getPosition();
+	rvec3 d = r.getDirection();
 
 	if( d[2] == 0.0 ) {
 		return false;
 	}
 
-	double t = -p[2]/d[2];
+	real t = -p[2]/d[2];
 
 	if( t <= RAY_EPSILON ) {
 		return false;
 	}
 
-	glm::dvec3 P = r.at( t );
+	rvec3 P = r.at( t );
 
 	if( P[0] < -0.5 || P[0] > 0.5 ) {	
 		return false;
@@ -35,11 +35,11 @@ bool Square::intersectLocal(ray& r, isect& i) const
 	i.setMaterial(this->getMaterial());
 	i.t = t;
 	if( d[2] > 0.0 ) {
-		i.N = glm::dvec3( 0.0, 0.0, -1.0 );
+		i.N = rvec3( 0.0, 0.0, -1.0 );
 	} else {
-		i.N = glm::dvec3( 0.0, 0.0, 1.0 );
+		i.N = rvec3( 0.0, 0.0, 1.0 );
 	}
 
-	i.setUVCoordinates( glm::dvec2(P[0] + 0.5, P[1] + 0.5) );
+	i.setUVCoordinates( rvec2(P[0] + 0.5, P[1] + 0.5) );
 	return true;
 }
@@ -12,14 +12,14 @@ public:
 	{
 	}
 
-	virtual bool intersectLocal(ray& r, isect& i ) const;
+	virtual bool intersectLocal(const ray& r, isect& i ) const;
 	virtual bool hasBoundingBoxCapability() const { return true; }
 
     virtual BoundingBox ComputeLocalBoundingBox()
     {
         BoundingBox localbounds;
-        localbounds.setMin(glm::dvec3(-0.5f, -0.5f, -RAY_EPSILON));
-		localbounds.setMax(glm::dvec3(0.5f, 0.5f, RAY_EPSILON));
+        localbounds.setMin(rvec3(-0.5f, -0.5f, -RAY_EPSILON));
+		localbounds.setMax(rvec3(0.5f, 0.5f, RAY_EPSILON));
         return localbounds;
     }
 
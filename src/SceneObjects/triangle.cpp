@@ -0,0 +1,357 @@
+#include "triangle.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRIANGLE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+
+typedef int (*BlockKernel)(const TriangleArrays& tris, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v);
+
+int intersectScalar(const TriangleArrays& tris, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v)
+{
+	int best = -1;
+	for (int k = first; k < first + count; k++) {
+		rvec3 v0(tris.v0[0][k], tris.v0[1][k], tris.v0[2][k]);
+		rvec3 e1(tris.e1[0][k], tris.e1[1][k], tris.e1[2][k]);
+		rvec3 e2(tris.e2[0][k], tris.e2[1][k], tris.e2[2][k]);
+		real t, hu, hv;
+		if (intersectTriangle(p, d, v0, e1, e2, tmin, tmax, t, hu, hv)) {
+			tmax = t;
+			u = hu;
+			v = hv;
+			best = k;
+		}
+	}
+	return best;
+}
+
+#ifdef TRIANGLE_X86_SIMD
+
+// Copy a partial group of triangles into zero-padded four-wide arrays so
+// the vector loads never run past the end of the caller's arrays.  Zero
+// edges give a zero determinant, so the padding lanes never hit.
+struct TailBlock
+{
+	real data[9][4];
+	TriangleArrays arrays;
+
+	const TriangleArrays* load(const TriangleArrays& tris, int first, int count)
+	{
+		for (int c = 0; c < 3; c++) {
+			copy(data[c], tris.v0[c], first, count);
+			copy(data[3 + c], tris.e1[c], first, count);
+			copy(data[6 + c], tris.e2[c], first, count);
+			arrays.v0[c] = data[c];
+			arrays.e1[c] = data[3 + c];
+			arrays.e2[c] = data[6 + c];
+		}
+		return &arrays;
+	}
+
+	static void copy(real* out, const real* in, int first, int count)
+	{
+		for (int k = 0; k < 4; k++)
+			out[k] = k < count ? in[first + k] : 0.0;
+	}
+};
+
+// Pick the closest of the lanes set in mask, preferring lower lanes on a
+// tie, and lower tmax to it.  Returns the lane or -1.
+inline int closestLane(int mask, const real* t, const real* lu, const real* lv,
+	int lanes, real& tmax, real& u, real& v)
+{
+	int best = -1;
+	for (int k = 0; k < lanes; k++) {
+		if ((mask & (1 << k)) && t[k] < tmax) {
+			tmax = t[k];
+			u = lu[k];
+			v = lv[k];
+			best = k;
+		}
+	}
+	return best;
+}
+
+// The vector kernels evaluate exactly the operations of intersectTriangle()
+// lane by lane, so they agree with the scalar kernel bit for bit.
+
+#ifdef RAY_FLOAT
+
+// Four float lanes, the same block of faces the double AVX kernel takes.
+__attribute__((target("sse")))
+int intersectSse(const TriangleArrays& all, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 lo = _mm_set1_ps(-TRIANGLE_EDGE_SLACK);
+	const __m128 hi = _mm_set1_ps(1.0f + TRIANGLE_EDGE_SLACK);
+	const __m128 px = _mm_set1_ps(p[0]), py = _mm_set1_ps(p[1]), pz = _mm_set1_ps(p[2]);
+	const __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+	const __m128 vtmin = _mm_set1_ps(tmin);
+
+	int best = -1;
+	for (int base = first; base < first + count; base += 4) {
+		int lanes = first + count - base < 4 ? first + count - base : 4;
+		TailBlock tail;
+		const TriangleArrays* tris = &all;
+		int k = base;
+		if (lanes < 4) {
+			tris = tail.load(all, base, lanes);
+			k = 0;
+		}
+
+		__m128 e1x = _mm_loadu_ps(tris->e1[0] + k);
+		__m128 e1y = _mm_loadu_ps(tris->e1[1] + k);
+		__m128 e1z = _mm_loadu_ps(tris->e1[2] + k);
+		__m128 e2x = _mm_loadu_ps(tris->e2[0] + k);
+		__m128 e2y = _mm_loadu_ps(tris->e2[1] + k);
+		__m128 e2z = _mm_loadu_ps(tris->e2[2] + k);
+
+		__m128 pvx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 pvy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pvz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, pvx), _mm_mul_ps(e1y, pvy)),
+			_mm_mul_ps(e1z, pvz));
+		__m128 mask = _mm_cmpneq_ps(det, zero);
+		if (_mm_movemask_ps(mask) == 0) continue;
+		__m128 invDet = _mm_div_ps(one, det);
+
+		__m128 tx = _mm_sub_ps(px, _mm_loadu_ps(tris->v0[0] + k));
+		__m128 ty = _mm_sub_ps(py, _mm_loadu_ps(tris->v0[1] + k));
+		__m128 tz = _mm_sub_ps(pz, _mm_loadu_ps(tris->v0[2] + k));
+		__m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, pvx), _mm_mul_ps(ty, pvy)),
+			_mm_mul_ps(tz, pvz)), invDet);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, lo));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(uu, hi));
+		if (_mm_movemask_ps(mask) == 0) continue;
+
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		__m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+			_mm_mul_ps(dz, qz)), invDet);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, lo));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), hi));
+		__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+			_mm_mul_ps(e2z, qz)), invDet);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(tt, vtmin));
+		int bits = _mm_movemask_ps(mask);
+		if (bits == 0) continue;
+
+		float t[4], lu[4], lv[4];
+		_mm_storeu_ps(t, tt);
+		_mm_storeu_ps(lu, uu);
+		_mm_storeu_ps(lv, vv);
+		int lane = closestLane(bits, t, lu, lv, lanes, tmax, u, v);
+		if (lane >= 0) best = base + lane;
+	}
+	return best;
+}
+
+#else
+
+__attribute__((target("avx")))
+int intersectAvx(const TriangleArrays& all, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v)
+{
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d lo = _mm256_set1_pd(-TRIANGLE_EDGE_SLACK);
+	const __m256d hi = _mm256_set1_pd(1.0 + TRIANGLE_EDGE_SLACK);
+	const __m256d px = _mm256_set1_pd(p[0]), py = _mm256_set1_pd(p[1]), pz = _mm256_set1_pd(p[2]);
+	const __m256d dx = _mm256_set1_pd(d[0]), dy = _mm256_set1_pd(d[1]), dz = _mm256_set1_pd(d[2]);
+	const __m256d vtmin = _mm256_set1_pd(tmin);
+
+	int best = -1;
+	for (int base = first; base < first + count; base += 4) {
+		int lanes = first + count - base < 4 ? first + count - base : 4;
+		TailBlock tail;
+		const TriangleArrays* tris = &all;
+		int k = base;
+		if (lanes < 4) {
+			tris = tail.load(all, base, lanes);
+			k = 0;
+		}
+
+		__m256d e1x = _mm256_loadu_pd(tris->e1[0] + k);
+		__m256d e1y = _mm256_loadu_pd(tris->e1[1] + k);
+		__m256d e1z = _mm256_loadu_pd(tris->e1[2] + k);
+		__m256d e2x = _mm256_loadu_pd(tris->e2[0] + k);
+		__m256d e2y = _mm256_loadu_pd(tris->e2[1] + k);
+		__m256d e2z = _mm256_loadu_pd(tris->e2[2] + k);
+
+		// pvec = d x e2, det = e1 . pvec
+		__m256d pvx = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+		__m256d pvy = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+		__m256d pvz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+		__m256d det = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, pvx), _mm256_mul_pd(e1y, pvy)),
+			_mm256_mul_pd(e1z, pvz));
+		__m256d mask = _mm256_cmp_pd(det, zero, _CMP_NEQ_OQ);
+		if (_mm256_movemask_pd(mask) == 0) continue;
+		__m256d invDet = _mm256_div_pd(one, det);
+
+		// u = (p - v0) . pvec / det
+		__m256d tx = _mm256_sub_pd(px, _mm256_loadu_pd(tris->v0[0] + k));
+		__m256d ty = _mm256_sub_pd(py, _mm256_loadu_pd(tris->v0[1] + k));
+		__m256d tz = _mm256_sub_pd(pz, _mm256_loadu_pd(tris->v0[2] + k));
+		__m256d uu = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx, pvx), _mm256_mul_pd(ty, pvy)),
+			_mm256_mul_pd(tz, pvz)), invDet);
+		mask = _mm256_and_pd(mask, _mm256_cmp_pd(uu, lo, _CMP_GE_OQ));
+		mask = _mm256_and_pd(mask, _mm256_cmp_pd(uu, hi, _CMP_LE_OQ));
+		if (_mm256_movemask_pd(mask) == 0) continue;
+
+		// qvec = tvec x e1, v = d . qvec / det, t = e2 . qvec / det
+		__m256d qx = _mm256_sub_pd(_mm256_mul_pd(ty, e1z), _mm256_mul_pd(tz, e1y));
+		__m256d qy = _mm256_sub_pd(_mm256_mul_pd(tz, e1x), _mm256_mul_pd(tx, e1z));
+		__m256d qz = _mm256_sub_pd(_mm256_mul_pd(tx, e1y), _mm256_mul_pd(ty, e1x));
+		__m256d vv = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx), _mm256_mul_pd(dy, qy)),
+			_mm256_mul_pd(dz, qz)), invDet);
+		mask = _mm256_and_pd(mask, _mm256_cmp_pd(vv, lo, _CMP_GE_OQ));
+		mask = _mm256_and_pd(mask, _mm256_cmp_pd(_mm256_add_pd(uu, vv), hi, _CMP_LE_OQ));
+		__m256d tt = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, qx), _mm256_mul_pd(e2y, qy)),
+			_mm256_mul_pd(e2z, qz)), invDet);
+		mask = _mm256_and_pd(mask, _mm256_cmp_pd(tt, vtmin, _CMP_GE_OQ));
+		int bits = _mm256_movemask_pd(mask);
+		if (bits == 0) continue;
+
+		double t[4], lu[4], lv[4];
+		_mm256_storeu_pd(t, tt);
+		_mm256_storeu_pd(lu, uu);
+		_mm256_storeu_pd(lv, vv);
+		int lane = closestLane(bits, t, lu, lv, lanes, tmax, u, v);
+		if (lane >= 0) best = base + lane;
+	}
+	return best;
+}
+
+__attribute__((target("sse2")))
+int intersectSse2(const TriangleArrays& all, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v)
+{
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d lo = _mm_set1_pd(-TRIANGLE_EDGE_SLACK);
+	const __m128d hi = _mm_set1_pd(1.0 + TRIANGLE_EDGE_SLACK);
+	const __m128d px = _mm_set1_pd(p[0]), py = _mm_set1_pd(p[1]), pz = _mm_set1_pd(p[2]);
+	const __m128d dx = _mm_set1_pd(d[0]), dy = _mm_set1_pd(d[1]), dz = _mm_set1_pd(d[2]);
+	const __m128d vtmin = _mm_set1_pd(tmin);
+
+	int best = -1;
+	for (int base = first; base < first + count; base += 2) {
+		int lanes = first + count - base < 2 ? 1 : 2;
+		TailBlock tail;
+		const TriangleArrays* tris = &all;
+		int k = base;
+		if (lanes < 2) {
+			tris = tail.load(all, base, lanes);
+			k = 0;
+		}
+
+		__m128d e1x = _mm_loadu_pd(tris->e1[0] + k);
+		__m128d e1y = _mm_loadu_pd(tris->e1[1] + k);
+		__m128d e1z = _mm_loadu_pd(tris->e1[2] + k);
+		__m128d e2x = _mm_loadu_pd(tris->e2[0] + k);
+		__m128d e2y = _mm_loadu_pd(tris->e2[1] + k);
+		__m128d e2z = _mm_loadu_pd(tris->e2[2] + k);
+
+		__m128d pvx = _mm_sub_pd(_mm_mul_pd(dy, e2z), _mm_mul_pd(dz, e2y));
+		__m128d pvy = _mm_sub_pd(_mm_mul_pd(dz, e2x), _mm_mul_pd(dx, e2z));
+		__m128d pvz = _mm_sub_pd(_mm_mul_pd(dx, e2y), _mm_mul_pd(dy, e2x));
+		__m128d det = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1x, pvx), _mm_mul_pd(e1y, pvy)),
+			_mm_mul_pd(e1z, pvz));
+		__m128d mask = _mm_cmpneq_pd(det, zero);
+		if (_mm_movemask_pd(mask) == 0) continue;
+		__m128d invDet = _mm_div_pd(one, det);
+
+		__m128d tx = _mm_sub_pd(px, _mm_loadu_pd(tris->v0[0] + k));
+		__m128d ty = _mm_sub_pd(py, _mm_loadu_pd(tris->v0[1] + k));
+		__m128d tz = _mm_sub_pd(pz, _mm_loadu_pd(tris->v0[2] + k));
+		__m128d uu = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(tx, pvx), _mm_mul_pd(ty, pvy)),
+			_mm_mul_pd(tz, pvz)), invDet);
+		mask = _mm_and_pd(mask, _mm_cmpge_pd(uu, lo));
+		mask = _mm_and_pd(mask, _mm_cmple_pd(uu, hi));
+		if (_mm_movemask_pd(mask) == 0) continue;
+
+		__m128d qx = _mm_sub_pd(_mm_mul_pd(ty, e1z), _mm_mul_pd(tz, e1y));
+		__m128d qy = _mm_sub_pd(_mm_mul_pd(tz, e1x), _mm_mul_pd(tx, e1z));
+		__m128d qz = _mm_sub_pd(_mm_mul_pd(tx, e1y), _mm_mul_pd(ty, e1x));
+		__m128d vv = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, qx), _mm_mul_pd(dy, qy)),
+			_mm_mul_pd(dz, qz)), invDet);
+		mask = _mm_and_pd(mask, _mm_cmpge_pd(vv, lo));
+		mask = _mm_and_pd(mask, _mm_cmple_pd(_mm_add_pd(uu, vv), hi));
+		__m128d tt = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(e2x, qx), _mm_mul_pd(e2y, qy)),
+			_mm_mul_pd(e2z, qz)), invDet);
+		mask = _mm_and_pd(mask, _mm_cmpge_pd(tt, vtmin));
+		int bits = _mm_movemask_pd(mask);
+		if (bits == 0) continue;
+
+		double t[2], lu[2], lv[2];
+		_mm_storeu_pd(t, tt);
+		_mm_storeu_pd(lu, uu);
+		_mm_storeu_pd(lv, vv);
+		int lane = closestLane(bits, t, lu, lv, lanes, tmax, u, v);
+		if (lane >= 0) best = base + lane;
+	}
+	return best;
+}
+
+#endif // RAY_FLOAT
+
+#endif // TRIANGLE_X86_SIMD
+
+struct KernelChoice
+{
+	BlockKernel kernel;
+	const char* name;
+
+	KernelChoice() : kernel(intersectScalar), name("scalar")
+	{
+#ifdef TRIANGLE_X86_SIMD
+		__builtin_cpu_init();
+#ifdef RAY_FLOAT
+		if (__builtin_cpu_supports("sse")) {
+			kernel = intersectSse;
+			name = "sse";
+		}
+#else
+		if (__builtin_cpu_supports("avx")) {
+			kernel = intersectAvx;
+			name = "avx";
+		} else if (__builtin_cpu_supports("sse2")) {
+			kernel = intersectSse2;
+			name = "sse2";
+		}
+#endif
+#endif
+	}
+};
+
+const KernelChoice& kernelChoice()
+{
+	static const KernelChoice choice;
+	return choice;
+}
+
+}
+
+int intersectTriangles(const TriangleArrays& tris, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v)
+{
+	return kernelChoice().kernel(tris, first, count, p, d, tmin, tmax, u, v);
+}
+
+const char* triangleKernelName()
+{
+	return kernelChoice().name;
+}
@@ -0,0 +1,104 @@
+#ifndef TRIANGLE_H__
+#define TRIANGLE_H__
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "../scene/real.h"
+
+// Ray/triangle kernels shared by Trimesh and anything that wants to
+// benchmark them.  Both are two-sided and accept hits on the edges.
+
+// Slack on the barycentric range tests.  Two triangles sharing an edge
+// compute it from different vertices, so rounding can put a ray that
+// passes right over the edge outside both of them, leaving a crack of
+// background pixels along it; with the slack both accept such a ray.
+#ifdef RAY_FLOAT
+const real TRIANGLE_EDGE_SLACK = 1e-5f;
+#else
+const real TRIANGLE_EDGE_SLACK = 1e-9;
+#endif
+
+// Moller-Trumbore test against the triangle (v0, v0 + e1, v0 + e2) with
+// the edges precomputed.  On a hit with tmin <= t < tmax returns true with
+// t and the barycentric weights u, v of the second and third vertices
+// (the first vertex gets 1 - u - v), which may stray outside [0, 1] by
+// TRIANGLE_EDGE_SLACK.  Rejects as soon as any of u, v or t is known to
+// be out of range.
+inline bool intersectTriangle(const rvec3& p, const rvec3& d,
+	const rvec3& v0, const rvec3& e1, const rvec3& e2,
+	real tmin, real tmax, real& t, real& u, real& v)
+{
+	rvec3 pvec = glm::cross(d, e2);
+	real det = glm::dot(e1, pvec);
+	if (det == 0.0) return false;
+	real invDet = real(1.0) / det;
+
+	const real lo = -TRIANGLE_EDGE_SLACK;
+	const real hi = real(1.0) + TRIANGLE_EDGE_SLACK;
+
+	rvec3 tvec = p - v0;
+	u = glm::dot(tvec, pvec) * invDet;
+	if (u < lo || u > hi) return false;
+
+	rvec3 qvec = glm::cross(tvec, e1);
+	v = glm::dot(d, qvec) * invDet;
+	if (v < lo || u + v > hi) return false;
+
+	t = glm::dot(e2, qvec) * invDet;
+	return t >= tmin && t < tmax;
+}
+
+// The original plane-then-inside test: intersect the plane (n, dist),
+// then check the hit point against the three edges of abc.  Barycentrics
+// come from absolute-position determinants, which lose precision (or
+// divide by zero) for triangles whose plane passes near the origin.
+// Nothing renders with it; it is the reference intersectTriangle() is
+// compared and benchmarked against.
+inline bool intersectTrianglePlane(const rvec3& p, const rvec3& d,
+	const rvec3& a, const rvec3& b, const rvec3& c,
+	const rvec3& n, real dist, real tmin, real& t, rvec3& bary)
+{
+	real nd = glm::dot(n, d);
+	if (nd == 0.0) return false;
+
+	t = (dist - glm::dot(n, p)) / nd;
+	rvec3 q = p + t * d;
+
+	if (t < tmin ||
+		glm::dot(glm::cross(b - a, q - a), n) < 0.0 ||
+		glm::dot(glm::cross(c - b, q - b), n) < 0.0 ||
+		glm::dot(glm::cross(a - c, q - c), n) < 0.0)
+		return false;
+
+	real denDet = glm::dot(a, glm::cross(b, c));
+	bary[0] = glm::dot(q, glm::cross(b, c)) / denDet;
+	bary[1] = glm::dot(a, glm::cross(q, c)) / denDet;
+	bary[2] = glm::dot(a, glm::cross(b, q)) / denDet;
+	return true;
+}
+
+// A run of triangles in structure-of-arrays form: the first vertex and
+// the two edges of each triangle, one array per coordinate.
+struct TriangleArrays
+{
+	const real* v0[3];
+	const real* e1[3];
+	const real* e2[3];
+};
+
+// Test p + t*d against triangles [first, first + count) of tris with the
+// widest SIMD kernel the CPU supports (chosen once at startup), four
+// triangles at a time.  Returns the index of the closest triangle hit with
+// tmin <= t < tmax, or -1; on a hit tmax is lowered to its t and u, v are
+// its barycentrics as for intersectTriangle().  Ties go to the lowest
+// index, so the result matches testing the triangles one by one.
+int intersectTriangles(const TriangleArrays& tris, int first, int count,
+	const rvec3& p, const rvec3& d, real tmin, real& tmax,
+	real& u, real& v);
+
+// The kernel intersectTriangles() dispatches to: "avx", "sse2" or "scalar",
+// or "sse" or "scalar" in the float build.
+const char* triangleKernelName();
+
+#endif // TRIANGLE_H__
@@ -10,42 +10,133 @@ extern TraceUI* traceUI;
 
 using namespace std;
 
-Trimesh::~Trimesh()
+void TrimeshFaceArrays::push_back( const rvec3& a, const rvec3& edge1,
+	const rvec3& edge2, const rvec3& normal, real d )
+{
+	for( int k = 0; k < 3; ++k )
+	{
+		v0[k].push_back( a[k] );
+		e1[k].push_back( edge1[k] );
+		e2[k].push_back( edge2[k] );
+		n[k].push_back( normal[k] );
+	}
+	dist.push_back( d );
+}
+
+namespace {
+
+void permuteArray( std::vector<real>& v, const std::vector<int>& order )
+{
+	std::vector<real> out( order.size() );
+	for( size_t k = 0; k < order.size(); ++k )
+		out[k] = v[order[k]];
+	v.swap( out );
+}
+
+}
+
+void TrimeshFaceArrays::permute( const std::vector<int>& order )
+{
+	for( int k = 0; k < 3; ++k )
+	{
+		permuteArray( v0[k], order );
+		permuteArray( e1[k], order );
+		permuteArray( e2[k], order );
+		permuteArray( n[k], order );
+	}
+	permuteArray( dist, order );
+}
+
+TriangleArrays TrimeshFaceArrays::triangles() const
+{
+	TriangleArrays t;
+	for( int k = 0; k < 3; ++k )
+	{
+		t.v0[k] = v0[k].data();
+		t.e1[k] = e1[k].data();
+		t.e2[k] = e2[k].data();
+	}
+	return t;
+}
+
+void TrimeshFaceArrays::reserve( size_t count )
+{
+	for( int k = 0; k < 3; ++k )
+	{
+		v0[k].reserve( count );
+		e1[k].reserve( count );
+		e2[k].reserve( count );
+		n[k].reserve( count );
+	}
+	dist.reserve( count );
+}
+
+void TrimeshFaceArrays::clear()
+{
+	for( int k = 0; k < 3; ++k )
+	{
+		v0[k].clear();
+		e1[k].clear();
+		e2[k].clear();
+		n[k].clear();
+	}
+	dist.clear();
+}
+
+TrimeshData::~TrimeshData()
 {
 	for( Materials::iterator i = materials.begin(); i != materials.end(); ++i )
 		delete *i;
 }
 
+Trimesh::~Trimesh()
+{
+}
+
 // must add vertices, normals, and materials IN ORDER
-void Trimesh::addVertex( const glm::dvec3 &v )
+void Trimesh::addVertex( const rvec3 &v )
 {
-    vertices.push_back( v );
+    mesh->vertices.push_back( v );
 }
 
 void Trimesh::addMaterial( Material *m )
 {
-    materials.push_back( m );
+    mesh->materials.push_back( m );
 }
 
-void Trimesh::addNormal( const glm::dvec3 &n )
+void Trimesh::addNormal( const rvec3 &n )
 {
-    normals.push_back( n );
+    mesh->normals.push_back( n );
+}
+
+void Trimesh::reserveFaces( int count )
+{
+    mesh->indices.reserve( mesh->indices.size() + 3 * count );
+    mesh->faces.reserve( mesh->faces.dist.size() + count );
 }
 
 // Returns false if the vertices a,b,c don't all exist
 bool Trimesh::addFace( int a, int b, int c )
 {
-    int vcnt = vertices.size();
+    int vcnt = mesh->vertices.size();
 
-    if( a >= vcnt || b >= vcnt || c >= vcnt ) return false;
+    if( a < 0 || b < 0 || c < 0 || a >= vcnt || b >= vcnt || c >= vcnt ) return false;
 
-    TrimeshFace *newFace = new TrimeshFace( scene, new Material(*this->material), this, a, b, c );
-    newFace->setTransform(this->transform);
-    if (!newFace->degen) faces.push_back( newFace );
+    const rvec3& a_coords = mesh->vertices[a];
+    const rvec3& b_coords = mesh->vertices[b];
+    const rvec3& c_coords = mesh->vertices[c];
 
+    // Degenerate faces can never be hit, so they are not stored at all.
+    rvec3 vab = b_coords - a_coords;
+    rvec3 vac = c_coords - a_coords;
+    rvec3 normal = glm::cross( vab, vac );
+    if( glm::length(normal) == 0.0 ) return true;
+    normal = glm::normalize( normal );
 
-    // Don't add faces to the scene's object list so we can cull by bounding box
-    // scene->add(newFace);
+    mesh->indices.push_back( a );
+    mesh->indices.push_back( b );
+    mesh->indices.push_back( c );
+    mesh->faces.push_back( a_coords, vab, vac, normal, glm::dot( normal, a_coords ) );
     return true;
 }
 
@@ -53,96 +144,136 @@ const char* Trimesh::doubleCheck()
 // Check to make sure that if we have per-vertex materials or normals
 // they are the right number.
 {
-    if( !materials.empty() && materials.size() != vertices.size() )
+    const TrimeshData& m = *mesh;
+    if( !m.materials.empty() && m.materials.size() != m.vertices.size() )
         return "Bad Trimesh: Wrong number of materials.";
-    if( !normals.empty() && normals.size() != vertices.size() )
+    if( !m.normals.empty() && m.normals.size() != m.vertices.size() )
         return "Bad Trimesh: Wrong number of normals.";
 
     return 0;
 }
 
-bool Trimesh::intersectLocal(ray& r, isect& i) const
+void Trimesh::buildBVH()
+{
+	TrimeshData& m = *mesh;
+	int count = m.faceCount();
+	std::vector<BoundingBox> faceBounds( count );
+	for( int f = 0; f < count; ++f )
+	{
+		const int* ids = m.face( f );
+		rvec3 a = m.vertices[ids[0]];
+		rvec3 b = m.vertices[ids[1]];
+		rvec3 c = m.vertices[ids[2]];
+		faceBounds[f] = BoundingBox( glm::min( glm::min( a, b ), c ), glm::max( glm::max( a, b ), c ) );
+	}
+
+	m.bvh.build( faceBounds, bvhLeafSize );
+
+	// store the faces in leaf order
+	const std::vector<int>& order = m.bvh.order();
+	std::vector<int> indices( m.indices.size() );
+	for( int f = 0; f < count; ++f )
+		for( int k = 0; k < 3; ++k )
+			indices[3 * f + k] = m.indices[3 * order[f] + k];
+	m.indices.swap( indices );
+	m.faces.permute( order );
+}
+
+bool Trimesh::intersectLocal(const ray& r, isect& i) const
 {
-	typedef Faces::const_iterator iter;
+	const TrimeshData& m = *mesh;
 	bool have_one = false;
-	for( iter j = faces.begin(); j != faces.end(); ++j )
+	if( m.bvh.empty() )
+	{
+		real tmax = REAL_MAX;
+		have_one = intersectFaces( 0, m.faceCount(), r, tmax, i );
+	}
+	else
 	{
-		isect cur;
-		if( (*j)->intersectLocal( r, cur ) )
-		{
-			if( !have_one || (cur.t < i.t) )
-			{
-				i = cur;
+		real tmax = REAL_MAX;
+		m.bvh.traverse( r.p, r.d, tmax, [&]( int first, int count ) {
+			if( intersectFaces( first, count, r, tmax, i ) )
 				have_one = true;
-			}
-		}
+			return false;
+		} );
 	}
 	if( !have_one ) i.setT(1000.0);
+	else
+	{
+		// the material is looked up through materialAt() once the nearest
+		// hit is known, so candidates never blend per-vertex materials
+		i.setObject( this );
+		if( m.materials.empty() ) i.setMaterial( *material );
+	}
 	return have_one;
 } 
 
-bool TrimeshFace::intersect(ray& r, isect& i) const {
-  return intersectLocal(r, i);
-}
-
-// Intersect ray r with the triangle abc.  If it hits returns true,
-// and put the parameter in t and the barycentric coordinates of the
-// intersection in u (alpha) and v (beta).
-bool TrimeshFace::intersectLocal(ray& r, isect& i) const
+const Material& Trimesh::materialAt( const isect& i ) const
 {
-    // Calculate points A, B and C
-    glm::dvec3 a = parent->vertices[ids[0]];
-    glm::dvec3 b = parent->vertices[ids[1]];
-    glm::dvec3 c = parent->vertices[ids[2]];
-
-    // Special case when ray and plane are parallel.
-    if(glm::dot(normal, r.d) == 0)
-        return false;
-
-    // For our ray, p(t) = (P + td), we can solve for t and get: t = -(n*P * d)/(n*d)
-    double t = (dist - glm::dot(normal, r.p))/(glm::dot(normal, r.d));
-
-    glm::dvec3 p = r.p + t*r.d; // Value of p(i.t)
+	const TrimeshData& m = *mesh;
+	if( m.materials.empty() || i.face < 0 )
+		return *material;
 
-    double cond1 = glm::dot(glm::cross(b-a, p-a), normal);
-    double cond2 = glm::dot(glm::cross(c-b, p-b), normal);
-    double cond3 = glm::dot(glm::cross(a-c, p-c), normal);
+	static thread_local Material blended;
+	const int* v = m.face( i.face );
+	blended = i.bary[0] * *m.materials[v[0]];
+	blended += i.bary[1] * *m.materials[v[1]];
+	blended += i.bary[2] * *m.materials[v[2]];
+	return blended;
+}
 
-    bool intersects = t >=0.00001 && cond1 >= 0 && cond2 >=0 && cond3 >= 0;
+bool Trimesh::occludedLocal(const ray& r, real tmax) const
+{
+	const TrimeshData& m = *mesh;
+	TriangleArrays tris = m.faces.triangles();
+	real u, v;
+	if( m.bvh.empty() )
+		return intersectTriangles( tris, 0, m.faceCount(), r.p, r.d, 0.00001, tmax, u, v ) >= 0;
 
-    if(intersects) {
-        // Computed from the fact that det([A B C]T) = A . (B x C), and det([A B C]) = det([A B C]T)
-        double denDet = glm::dot(a, glm::cross(b, c));
-        double alpha = glm::dot(p, glm::cross(b, c))/denDet;
-        double beta = glm::dot(a, glm::cross(p, c))/denDet;
-        double gamma = glm::dot(a, glm::cross(b, p))/denDet;
+	bool hit = false;
+	m.bvh.traverse( r.p, r.d, tmax, [&]( int first, int count ) {
+		real t = tmax;
+		hit = intersectTriangles( tris, first, count, r.p, r.d, 0.00001, t, u, v ) >= 0;
+		return hit;
+	} );
+	return hit;
+}
 
-        i.setBary(alpha, beta, gamma);
-        i.setT(t);
-        i.setN(normal);
-        i.setMaterial(*material);
-    }
+bool Trimesh::intersectFaces( int first, int count, const ray& r, real& tmax, isect& i ) const
+{
+    const TrimeshFaceArrays& fa = mesh->faces;
+    real u, v;
+    int f = intersectTriangles( fa.triangles(), first, count, r.p, r.d, 0.00001, tmax, u, v );
+    if( f < 0 )
+        return false;
 
-    return intersects;
+    i.setBary( 1.0 - u - v, u, v );
+    i.face = f;
+    i.setT( tmax );
+    i.setN( fa.normal( f ) );
+    return true;
 }
 
 void Trimesh::generateNormals()
 // Once you've loaded all the verts and faces, we can generate per
 // vertex normals by averaging the normals of the neighboring faces.
 {
-    int cnt = vertices.size();
+    const TrimeshData& m = *mesh;
+    Normals& normals = mesh->normals;
+    int cnt = m.vertices.size();
     normals.resize( cnt );
     int *numFaces = new int[ cnt ]; // the number of faces assoc. with each vertex
     memset( numFaces, 0, sizeof(int)*cnt );
     
-    for( Faces::iterator fi = faces.begin(); fi != faces.end(); ++fi )
+    for( int f = 0; f < m.faceCount(); ++f )
     {
-		glm::dvec3 faceNormal = (**fi).getNormal();
+		rvec3 faceNormal = m.faces.normal( f );
+		const int* ids = m.face( f );
         
         for( int i = 0; i < 3; ++i )
         {
-            normals[(**fi)[i]] += faceNormal;
-            ++numFaces[(**fi)[i]];
+            normals[ids[i]] += faceNormal;
+            ++numFaces[ids[i]];
         }
     }
 
@@ -153,6 +284,6 @@ void Trimesh::generateNormals()
     }
 
     delete [] numFaces;
-    vertNorms = true;
+    mesh->vertNorms = true;
 }
 
@@ -3,62 +3,124 @@
 
 #include <list>
 #include <vector>
+#include <memory>
 
 #include "../scene/ray.h"
 #include "../scene/material.h"
 #include "../scene/scene.h"
 #include "../scene/kdTree.h"
+#include "../scene/bvh.h"
+#include "triangle.h"
 
 #include <glm/vec3.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-class TrimeshFace;
+// Per-face data precomputed for intersection, stored as a structure of
+// arrays indexed by face so that a BVH leaf's faces sit next to each other
+// in memory.
+struct TrimeshFaceArrays
+{
+	std::vector<real> v0[3];		// first vertex
+	std::vector<real> e1[3];		// second vertex - first vertex
+	std::vector<real> e2[3];		// third vertex - first vertex
+	std::vector<real> n[3];		// unit face normal
+	std::vector<real> dist;		// n . v0
+
+	void push_back( const rvec3& a, const rvec3& edge1, const rvec3& edge2,
+		const rvec3& normal, real d );
+	// Reorder so that face k becomes face order[k].
+	void permute( const std::vector<int>& order );
+	void clear();
+	void reserve( size_t count );
+
+	rvec3 normal( int f ) const { return rvec3( n[0][f], n[1][f], n[2][f] ); }
+	TriangleArrays triangles() const;
+};
 
-class Trimesh : public MaterialSceneObject
+// The geometry of a mesh in its own local space: vertices, optional
+// per-vertex normals and materials, faces and the face BVH.  It is shared
+// by every Trimesh that instances the mesh, so a mesh placed under many
+// transforms is stored and built only once.
+struct TrimeshData
 {
-	friend class TrimeshFace;
-	typedef std::vector<glm::dvec3> Normals;
-	typedef std::vector<glm::dvec3> Vertices;
-	typedef std::vector<TrimeshFace*> Faces;
+	typedef std::vector<rvec3> Normals;
+	typedef std::vector<rvec3> Vertices;
 	typedef std::vector<Material*> Materials;
 
 	Vertices vertices;
-	Faces faces;
 	Normals normals;
 	Materials materials;
+	// three vertex indices per face
+	std::vector<int> indices;
+	TrimeshFaceArrays faces;
 	BoundingBox localBounds;
+	BVH bvh;
+	bool vertNorms;
+
+	TrimeshData() : vertNorms(false) {}
+	~TrimeshData();
+
+	int faceCount() const { return (int)indices.size() / 3; }
+	const int* face( int f ) const { return &indices[3 * f]; }
+};
+
+class Trimesh : public MaterialSceneObject
+{
+	typedef TrimeshData::Normals Normals;
+	typedef TrimeshData::Vertices Vertices;
+	typedef TrimeshData::Materials Materials;
+
+	std::shared_ptr<TrimeshData> mesh;
+
+	// target number of faces per BVH leaf; one vector block of
+	// intersectTriangles()
+	static const int bvhLeafSize = 4;
 
 public:
 	Trimesh( Scene *scene, Material *mat, TransformNode *transform )
 		: MaterialSceneObject(scene, mat), 
+		mesh(new TrimeshData),
 		displayListWithMaterials(0),
 		displayListWithoutMaterials(0)
 	{
 		this->transform = transform;
-		vertNorms = false;
 	}
 
-	bool vertNorms;
-
-	bool intersectLocal(ray& r, isect& i) const;
+	bool intersectLocal(const ray& r, isect& i) const;
+	bool occludedLocal(const ray& r, real tmax) const;
+	// Blends per-vertex materials, if there are any, into per-thread storage.
+	const Material& materialAt(const isect& i) const;
 
 	~Trimesh();
 
 	// must add vertices, normals, and materials IN ORDER
-	void addVertex( const glm::dvec3 & );
+	void addVertex( const rvec3 & );
 	void addMaterial( Material *m );
-	void addNormal( const glm::dvec3 & );
+	void addNormal( const rvec3 & );
 	bool addFace( int a, int b, int c );
+	// Make room for count more faces, for callers that know the count up front.
+	void reserveFaces( int count );
 
 	const char *doubleCheck();
 
 	void generateNormals();
 
+	// Build the face BVH in mesh-local space.  Call once all faces have
+	// been added; faces are reordered to match the BVH leaves.
+	void buildBVH();
+
+	// Make this trimesh another instance of an already built mesh.  The
+	// instance keeps its own transform and material.
+	void shareMesh( const std::shared_ptr<TrimeshData>& data ) { mesh = data; }
+	const std::shared_ptr<TrimeshData>& getMesh() const { return mesh; }
+	bool hasVertNorms() const { return mesh->vertNorms; }
+
 	bool hasBoundingBoxCapability() const { return true; }
 
 	BoundingBox ComputeLocalBoundingBox()
 	{
 		BoundingBox localbounds;
+		const Vertices& vertices = mesh->vertices;
 		if (vertices.size() == 0) return localbounds;
 		localbounds.setMax(vertices[0]);
 		localbounds.setMin(vertices[0]);
@@ -68,84 +130,19 @@ public:
 			localbounds.setMax(glm::max( localbounds.getMax(), *viter));
 			localbounds.setMin(glm::min( localbounds.getMin(), *viter));
 		}
-		localBounds = localbounds;
+		mesh->localBounds = localbounds;
 		return localbounds;
 	}
 
 protected:
+	// Intersect r with faces [first, first + count) in mesh-local space,
+	// accepting only hits closer than tmax.  On a hit lowers tmax and fills
+	// in t, N and the barycentrics of i.
+	bool intersectFaces( int first, int count, const ray& r, real& tmax, isect& i ) const;
+
 	void glDrawLocal(int quality, bool actualMaterials, bool actualTextures) const;
 	mutable int displayListWithMaterials;
 	mutable int displayListWithoutMaterials;
 };
 
-class TrimeshFace : public MaterialSceneObject
-{
-    Trimesh *parent;
-    int ids[3];
-    glm::dvec3 normal;
-    double dist;
-
-public:
-    TrimeshFace( Scene *scene, Material *mat, Trimesh *parent, int a, int b, int c)
-        : MaterialSceneObject( scene, mat )
-    {
-        this->parent = parent;
-        ids[0] = a;
-        ids[1] = b;
-        ids[2] = c;
-
-		// Compute the face normal here, not on the fly
-		glm::dvec3 a_coords = parent->vertices[a];
-		glm::dvec3 b_coords = parent->vertices[b];
-		glm::dvec3 c_coords = parent->vertices[c];
-
-		glm::dvec3 vab = (b_coords - a_coords);
-		glm::dvec3 vac = (c_coords - a_coords);
-		glm::dvec3 vcb = (b_coords - c_coords);
-        
-		if (glm::length(vab) == 0.0 || glm::length(vac) == 0.0 || glm::length(vcb) == 0.0)
-			degen = true;
-		else {
-			degen = false;
-			normal = glm::cross(b_coords - a_coords, c_coords - a_coords);
-			normal = glm::normalize(normal);
-			dist = glm::dot(normal, a_coords);
-		}
-		localbounds = ComputeLocalBoundingBox();
-		bounds = localbounds;
-    }
-
-	BoundingBox localbounds;
-	bool degen;
-
-    int operator[]( int i ) const
-    {
-        return ids[i];
-    }
-
-	glm::dvec3 getNormal()
-	{
-		return normal;
-	}
-
-    bool intersect(ray& r, isect& i ) const;
-    bool intersectLocal(ray& r, isect& i ) const;
-
-    bool hasBoundingBoxCapability() const { return true; }
-      
-    BoundingBox ComputeLocalBoundingBox()
-    {
-        BoundingBox localbounds;
-        localbounds.setMax(glm::max(parent->vertices[ids[0]], parent->vertices[ids[1]]));
-		localbounds.setMin(glm::min( parent->vertices[ids[0]], parent->vertices[ids[1]]));
-        
-        localbounds.setMax(glm::max(parent->vertices[ids[2]], localbounds.getMax()));
-		localbounds.setMin(glm::min( parent->vertices[ids[2]], localbounds.getMin()));
-        return localbounds;
-    }
-
-    const BoundingBox& getBoundingBox() const { return localbounds; }
-
- };
-
 #endif // TRIMESH_H__
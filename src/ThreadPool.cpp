@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int count)
+	: running(0), stopping(false)
+{
+	start(count);
+}
+
+ThreadPool::~ThreadPool()
+{
+	wait();
+	stop();
+}
+
+void ThreadPool::resize(unsigned int count)
+{
+	count = max(count, 1u);
+	if (count == size()) return;
+	stop();
+	start(count);
+}
+
+void ThreadPool::start(unsigned int count)
+{
+	stopping = false;
+	for (unsigned int i = 0; i < max(count, 1u); i++)
+		workers.push_back(thread(&ThreadPool::workerLoop, this));
+}
+
+void ThreadPool::stop()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (auto it = workers.begin(); it != workers.end(); ++it)
+		it->join();
+	workers.clear();
+}
+
+void ThreadPool::submit(function<void()> job)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		jobs.push_back(std::move(job));
+	}
+	jobReady.notify_one();
+}
+
+bool ThreadPool::runOne(unique_lock<mutex>& held)
+{
+	if (jobs.empty()) return false;
+	function<void()> job = std::move(jobs.front());
+	jobs.pop_front();
+	running++;
+	held.unlock();
+	job();
+	held.lock();
+	running--;
+	jobDone.notify_all();
+	return true;
+}
+
+void ThreadPool::workerLoop()
+{
+	unique_lock<mutex> held(lock);
+	for (;;) {
+		jobReady.wait(held, [this] { return stopping || !jobs.empty(); });
+		if (stopping) return;
+		runOne(held);
+	}
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)>& job)
+{
+	if (count <= 0) return;
+	int remaining = count;
+	for (int k = 0; k < count; k++)
+		submit([&, k] {
+			job(k);
+			lock_guard<mutex> guard(lock);
+			remaining--;
+		});
+
+	// Help out instead of just blocking, so a job that itself calls
+	// parallelFor cannot starve the pool.
+	unique_lock<mutex> held(lock);
+	while (remaining > 0)
+		if (!runOne(held))
+			jobDone.wait(held, [&] { return remaining == 0 || !jobs.empty(); });
+}
+
+void ThreadPool::wait()
+{
+	unique_lock<mutex> held(lock);
+	jobDone.wait(held, [this] { return jobs.empty() && running == 0; });
+}
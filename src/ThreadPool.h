@@ -0,0 +1,56 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// A fixed set of long-lived worker threads that run queued jobs in
+// submission order.  The RayTracer owns one and uses it for render and
+// anti-aliasing passes; anything else that wants parallel work (scene
+// building, texture loading) should submit to the same pool rather than
+// start threads of its own.
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned int count);
+	~ThreadPool();
+
+	// Change the number of workers.  Jobs already running finish on the
+	// old workers and queued ones are left for the new workers.  Must not
+	// be called from a pool job, which would wait for itself.
+	void resize(unsigned int count);
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+	// Queue a job and return immediately.
+	void submit(std::function<void()> job);
+
+	// Run job(0) ... job(count - 1) on the pool and return once all of
+	// them have finished.  Safe to call from inside a pool job: the
+	// calling thread runs pending jobs while it waits.
+	void parallelFor(int count, const std::function<void(int)>& job);
+
+	// Block until the queue is empty and no job is running.  Not for use
+	// from inside a pool job, which would wait for itself.
+	void wait();
+
+private:
+	void start(unsigned int count);
+	void stop();
+	void workerLoop();
+	// Pop and run one queued job if there is one; lock must be held and
+	// is held again on return.
+	bool runOne(std::unique_lock<std::mutex>& lock);
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex lock;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	int running;
+	bool stopping;
+};
+
+#endif // __THREADPOOL_H__
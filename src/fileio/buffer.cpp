@@ -1,5 +1,5 @@
 /*
-  The Buffer class is essentially a wrapper for an istream.
+  The Buffer class holds the text of a whole scene file, read in one go.
   It is here mainly to keep track of the current file location
   (line number, column number) to print intelligent error messages.
 
@@ -9,6 +9,7 @@
 */
 
 #include <string>
+#include <sstream>
 #include "buffer.h"
 
 #include "../parser/Parser.h"
@@ -16,18 +17,37 @@
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Buffer::Buffer(FILE*,...) constructor
+// Buffer::Buffer(istream&,...) constructor
 //
-//   This constructor sets up the initial state that we need in order
-// to read files.
+//   This constructor reads the whole file into memory with a single read
+// where the stream can tell its size, so the scanner never goes back to
+// the stream for more.
 //
 
 Buffer::Buffer(istream& is, bool printChars, bool printLines)
-  : inStream( is )
 { 
-    PositionInCurrentLine = Line.begin();
+    Text = "\n";
+    is.seekg( 0, std::ios::end );
+    std::streamoff size = is.tellg();
+    if (size > 0) {
+      is.seekg( 0, std::ios::beg );
+      Text.resize( 1 + (size_t)size );
+      is.read( &Text[1], size );
+      Text.resize( 1 + (size_t)is.gcount() );
+    } else {
+      // not seekable; copy it through
+      is.clear();
+      std::ostringstream rest;
+      rest << is.rdbuf();
+      Text += rest.str();
+    }
+    if (Text[Text.size() - 1] != '\n') Text += '\n';
+
+    Next                  = Text.data() + 1;
+    End                   = Text.data() + Text.size();
+    LineStart             = Next - 1;
+    AtEOF                 = false;
     LineNumber            = 0;
-    ColNumber             = 0;
     LastPrintedLine       = 0;
     
     _printChars = printChars;
@@ -37,66 +57,37 @@ Buffer::Buffer(istream& is, bool printChars, bool printLines)
 
 //////////////////////////////////////////////////////////////////////////
 //
-// char Buffer::GetCh() private method
+// void Buffer::NewLine() private method
 //
-//   GetCh() gets a new character from the buffer and returns it
+//   NewLine() moves the line count and the line start on to the line
+// that starts at the next character.  It also handles listings, if
+// necessary.
 //
 
-char Buffer::GetCh() {
-  if (!inStream) {
-    return '\0';
-  }
+void Buffer::NewLine() {
+  LineStart = Next;
+  LineNumber ++;
 
-  // advance position
-  if(!Line.empty() && PositionInCurrentLine != Line.end()) {
-	  PositionInCurrentLine++;
-	  ColNumber++;
-  }
+  if (_printLines) PrintLine( std::cout );
+}
 
-  while (PositionInCurrentLine == Line.end() || Line.empty()) {
-    // need to read another line of input from the file
 
-    GetLine();
-    if (!inStream) {
-      return '\0';
+char Buffer::SkipTo(const char* p) {
+  if (p == Next - 1) return *p;
+  // GetCh() takes care of a newline just before p
+  for (const char* q = Next - 1; q < p - 1; q++) {
+    if (*q == '\n') {
+      Next = q + 1;
+      NewLine();
     }
   }
-
-
-  // extract character from line buffer
-  char CurrentCh = *PositionInCurrentLine;
-
-  if (_printChars) {
-    std::cout << "Read character `" << CurrentCh << "'" << std::endl;
-  }
-
-  return CurrentCh;
+  Next = p;
+  return GetCh();
 }
 
 
-//////////////////////////////////////////////////////////////////////////
-//
-// void Buffer::GetLine() private method
-//
-//   GetLine() reads a new line from the file into the Line buffer
-// variable.  It also handles listings, if necessary.  Returns are false
-// for EOF or true for got a new buffer.
-//
-// This function is weak, in that it can't handle arbitrarily long lines
-// in a file.  Ideally it would be rewritten so that it can do this fine.
-// The real difficulty is in being able to print out, on demand, the whole
-// line of input, of arbitrary length.
-//
-
-void Buffer::GetLine() {
-  std::getline(inStream, Line);
-  Line.append( "\n" ); // because iostreams strip out the end-of-line char
-  PositionInCurrentLine = Line.begin();
-
-  ColNumber = 0;
-  LineNumber ++;
-
-  if (_printLines) PrintLine( std::cout );
+void Buffer::PrintCh(char c) const {
+  std::cout << "Read character `" << c << "'" << std::endl;
 }
 
 
@@ -109,7 +100,9 @@ void Buffer::GetLine() {
 
 void Buffer::PrintLine( ostream& out ) const {
   if (LineNumber > LastPrintedLine) {
-    out << "# " << Line << std::endl;
+    const char* lineEnd = LineStart;
+    while (lineEnd != End && *lineEnd != '\n') lineEnd++;
+    out << "# " << string( LineStart, lineEnd ) << "\n" << std::endl;
     LastPrintedLine = LineNumber;
   }
 }
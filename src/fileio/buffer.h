@@ -6,7 +6,7 @@
 
 
 /*
-  The Buffer class is essentially a wrapper for an istream.
+  The Buffer class holds the text of a whole scene file, read in one go.
   It is here mainly to keep track of the current file location
   (line number, column number) to print intelligent error messages.
 
@@ -29,25 +29,47 @@ using std::string;
 
 class Buffer {
  public:
+  // Reads all of file up front; the stream is not used afterwards.
   Buffer(std::istream& file, bool printChars, bool printLines);
 
-  char GetCh();			// Read and return next character
-  bool isEOF() { return !(inStream); }	// Return whether is end of file
+  // Read and return next character
+  char GetCh() {
+    if (Next == End) {
+      AtEOF = true;
+      return '\0';
+    }
+    if (*(Next - 1) == '\n') NewLine();
+    if (_printChars) PrintCh(*Next);
+    return *Next++;
+  }
+  bool isEOF() { return AtEOF; }	// Return whether is end of file
+
+  // The text from the last character GetCh() returned to the end of the
+  // file, for scanning a run of characters in place.  It always ends in a
+  // newline and the character at EndOfText() is a '\0'.  After scanning,
+  // SkipTo(p) makes the character at p, which may be on a later line, the
+  // current one and returns it.
+  const char* Position() const { return Next - 1; }
+  const char* EndOfText() const { return End; }
+  char SkipTo(const char* p);
 
   void PrintLine(std::ostream& out) const;		// Print current line
 
-  int  CurColumn() const { return ColNumber; }
+  int  CurColumn() const { return (int)(Next - 1 - LineStart); }
   int  CurLine() const { return LineNumber; }	// Return current line #
   
 protected:
-  void  GetLine();		// Read next line from file
+  void  NewLine();		// Step over a newline
+  void  PrintCh(char c) const;
 
-  std::istream& inStream;            // The file pointer to the source file
+  // The whole file, with a newline added if it did not end in one, and a
+  // newline in front so that the first GetCh() starts line 1.
+  std::string Text;
+  const char* Next;             // The character after the current one
+  const char* End;
+  const char* LineStart;        // The start of the current line
+  bool AtEOF;
 
-  std::string Line;                  // The line buffer
-  std::string::const_iterator PositionInCurrentLine;
-
-  int   ColNumber;		// The number of the current column
   int   LineNumber;             // The number of the line in the file
   mutable int   LastPrintedLine;        // The line number of the last printed line
 
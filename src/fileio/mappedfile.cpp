@@ -0,0 +1,69 @@
+#include "mappedfile.h"
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+	length = (size_t)info.st_size;
+	if (length == 0) {
+		// mmap refuses empty mappings
+		::close(fd);
+		base = "";
+		return true;
+	}
+	void* view = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file open
+	::close(fd);
+	if (view != MAP_FAILED) {
+		madvise(view, length, MADV_SEQUENTIAL);
+		base = (const char*)view;
+		mapped = true;
+		return true;
+	}
+	length = 0;
+#endif
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) return false;
+	char block[1 << 16];
+	size_t got;
+	while ((got = fread(block, 1, sizeof(block), file)) > 0)
+		copy.insert(copy.end(), block, block + got);
+	bool ok = !ferror(file);
+	fclose(file);
+	if (!ok) {
+		close();
+		return false;
+	}
+	base = copy.empty() ? "" : &copy[0];
+	length = copy.size();
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+	if (mapped) munmap((void*)base, length);
+#endif
+	mapped = false;
+	base = 0;
+	length = 0;
+	std::vector<char>().swap(copy);
+}
@@ -0,0 +1,40 @@
+//
+// mappedfile.h
+//
+// Read-only access to the whole of a file at once.
+//
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+// The contents of a file as one block of memory: memory mapped where the
+// system supports it, so that pages are only read in as they are touched
+// and several threads can scan different parts at once, and read into a
+// buffer otherwise.
+class MappedFile {
+public:
+	MappedFile() : base(0), length(0), mapped(false) {}
+	~MappedFile() { close(); }
+
+	// Returns false if the file cannot be opened or read.
+	bool open(const std::string& path);
+	void close();
+
+	const char* data() const { return base; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* base;
+	size_t length;
+	bool mapped;
+	std::vector<char> copy;		// the contents, when not mapped
+};
+
+#endif
@@ -0,0 +1,479 @@
+#include "meshfile.h"
+#include "mappedfile.h"
+
+#include "../parser/Tokenizer.h"
+#include "../ThreadPool.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+// An OBJ file larger than this is parsed in chunks of about this size.
+const size_t objChunkBytes = 1 << 22;
+
+bool isBlank( char c ) { return ' ' == c || '\t' == c || '\r' == c; }
+
+const char* skipBlanks( const char* p, const char* eol )
+{
+	while( p < eol && isBlank( *p ) ) p++;
+	return p;
+}
+
+// Read n numbers separated by blanks.
+bool scanNumbers( const char*& p, const char* eol, double* values, int n )
+{
+	for( int k = 0; k < n; k++ )
+	{
+		p = skipBlanks( p, eol );
+		const char* last = p;
+		while( last < eol && !isBlank( *last ) ) last++;
+		if( last == p || Tokenizer::ScanScalar( p, last, values[k] ) != last ) return false;
+		p = last;
+	}
+	return true;
+}
+
+// Read an OBJ index: 1-based, or negative to count back from the end.
+bool scanIndex( const char*& p, const char* eol, int& index )
+{
+	bool negative = p < eol && '-' == *p;
+	if( negative ) p++;
+	if( p == eol || !isdigit( *p ) ) return false;
+	long value = 0;
+	while( p < eol && isdigit( *p ) )
+	{
+		value = value * 10 + ( *p++ - '0' );
+		if( value > INT_MAX ) return false;
+	}
+	if( value == 0 ) return false;
+	index = negative ? -(int)value : (int)value;
+	return true;
+}
+
+// A face corner, as 0-based indices.  An index is either counted from the
+// start of the file or, for the negative indices of the file, from the
+// start of the chunk, as the chunk does not know how many came before it.
+struct ObjCorner {
+	enum { VERTEX_IN_CHUNK = 1, NORMAL_IN_CHUNK = 2, HAS_NORMAL = 4 };
+	int v, n;
+	int flags;
+};
+
+// Everything read from one chunk of an OBJ file.
+struct ObjChunk {
+	vector<glm::dvec3> vertices;
+	vector<glm::dvec3> normals;
+	vector<ObjCorner> corners;
+	vector<int> sizes;		// corners per face
+	const char* errorAt;	// start of a line that could not be parsed
+	ObjChunk() : errorAt( 0 ) {}
+};
+
+bool parseObjFace( const char* p, const char* eol, ObjChunk& chunk )
+{
+	int count = 0;
+	for( ;; )
+	{
+		p = skipBlanks( p, eol );
+		if( p == eol ) break;
+		ObjCorner corner;
+		corner.n = 0;
+		corner.flags = 0;
+		int index;
+		if( !scanIndex( p, eol, index ) ) return false;
+		if( index > 0 )
+			corner.v = index - 1;
+		else
+		{
+			corner.v = (int)chunk.vertices.size() + index;
+			corner.flags |= ObjCorner::VERTEX_IN_CHUNK;
+		}
+		if( p < eol && '/' == *p )
+		{
+			// skip the texture coordinate, if there is one
+			p++;
+			if( p < eol && '/' != *p && !isBlank( *p ) && !scanIndex( p, eol, index ) ) return false;
+			if( p < eol && '/' == *p )
+			{
+				p++;
+				if( !scanIndex( p, eol, index ) ) return false;
+				corner.flags |= ObjCorner::HAS_NORMAL;
+				if( index > 0 )
+					corner.n = index - 1;
+				else
+				{
+					corner.n = (int)chunk.normals.size() + index;
+					corner.flags |= ObjCorner::NORMAL_IN_CHUNK;
+				}
+			}
+		}
+		if( p < eol && !isBlank( *p ) ) return false;
+		chunk.corners.push_back( corner );
+		count++;
+	}
+	if( count < 3 ) return false;
+	chunk.sizes.push_back( count );
+	return true;
+}
+
+// Parse the lines in [p, end); p is at the start of a line.
+void parseObjChunk( const char* p, const char* end, ObjChunk& chunk )
+{
+	while( p < end )
+	{
+		const char* eol = (const char*)memchr( p, '\n', end - p );
+		if( !eol ) eol = end;
+		const char* q = skipBlanks( p, eol );
+		bool ok = true;
+		double xyz[3];
+		if( eol - q > 2 && 'v' == q[0] && isBlank( q[1] ) )
+		{
+			q += 2;
+			ok = scanNumbers( q, eol, xyz, 3 );
+			if( ok ) chunk.vertices.push_back( glm::dvec3( xyz[0], xyz[1], xyz[2] ) );
+		}
+		else if( eol - q > 3 && 'v' == q[0] && 'n' == q[1] && isBlank( q[2] ) )
+		{
+			q += 3;
+			ok = scanNumbers( q, eol, xyz, 3 );
+			if( ok ) chunk.normals.push_back( glm::dvec3( xyz[0], xyz[1], xyz[2] ) );
+		}
+		else if( eol - q > 2 && 'f' == q[0] && isBlank( q[1] ) )
+			ok = parseObjFace( q + 2, eol, chunk );
+		// anything else (comments, texture coordinates, groups,
+		// materials) is skipped
+
+		if( !ok )
+		{
+			chunk.errorAt = p;
+			return;
+		}
+		p = eol + 1;
+	}
+}
+
+void readObj( const char* data, size_t size, MeshFile& mesh, ThreadPool* pool )
+{
+	// Cut the file into chunks that start at line starts.
+	int count = 1;
+	if( pool && size > objChunkBytes )
+		count = (int)min( size / objChunkBytes + 1, (size_t)pool->size() * 4 );
+	vector<size_t> starts( count + 1, 0 );
+	starts[count] = size;
+	for( int k = 1; k < count; k++ )
+	{
+		size_t at = max( size * k / count, starts[k - 1] );
+		const char* eol = at < size ? (const char*)memchr( data + at, '\n', size - at ) : 0;
+		starts[k] = eol ? eol + 1 - data : size;
+	}
+
+	vector<ObjChunk> chunks( count );
+	if( count == 1 )
+		parseObjChunk( data, data + size, chunks[0] );
+	else
+		pool->parallelFor( count, [&]( int k ) {
+			parseObjChunk( data + starts[k], data + starts[k + 1], chunks[k] );
+		} );
+
+	size_t vertexTotal = 0, normalTotal = 0;
+	for( int k = 0; k < count; k++ )
+	{
+		if( chunks[k].errorAt )
+		{
+			ostringstream oss;
+			oss << "line " << std::count( data, chunks[k].errorAt, '\n' ) + 1 << " cannot be parsed";
+			throw MeshFileException( oss.str() );
+		}
+		vertexTotal += chunks[k].vertices.size();
+		normalTotal += chunks[k].normals.size();
+	}
+
+	mesh.vertices.reserve( vertexTotal );
+	vector<glm::dvec3> normals;
+	normals.reserve( normalTotal );
+	for( int k = 0; k < count; k++ )
+	{
+		mesh.vertices.insert( mesh.vertices.end(), chunks[k].vertices.begin(), chunks[k].vertices.end() );
+		normals.insert( normals.end(), chunks[k].normals.begin(), chunks[k].normals.end() );
+	}
+
+	// Resolve the corners and fan triangulate.  Normals are per corner
+	// in an OBJ file but per vertex in a Trimesh, so they are only kept if
+	// each vertex always comes with the same one.
+	vector<int> normalOf( normals.empty() ? 0 : vertexTotal, -1 );
+	bool keepNormals = !normals.empty();
+	size_t vertexBase = 0, normalBase = 0;
+	for( int k = 0; k < count; k++ )
+	{
+		const ObjChunk& chunk = chunks[k];
+		vector<ObjCorner>::const_iterator corner = chunk.corners.begin();
+		for( size_t f = 0; f < chunk.sizes.size(); f++ )
+		{
+			int first = 0, last = 0;
+			for( int c = 0; c < chunk.sizes[f]; c++, ++corner )
+			{
+				long v = corner->v + ( corner->flags & ObjCorner::VERTEX_IN_CHUNK ? (long)vertexBase : 0 );
+				if( v < 0 || v >= (long)vertexTotal )
+					throw MeshFileException( "face refers to a vertex that does not exist" );
+				if( keepNormals )
+				{
+					long n = corner->n + ( corner->flags & ObjCorner::NORMAL_IN_CHUNK ? (long)normalBase : 0 );
+					if( !( corner->flags & ObjCorner::HAS_NORMAL ) || ( normalOf[v] >= 0 && normalOf[v] != n ) )
+						keepNormals = false;
+					else if( n < 0 || n >= (long)normalTotal )
+						throw MeshFileException( "face refers to a normal that does not exist" );
+					else
+						normalOf[v] = (int)n;
+				}
+				if( c == 0 )
+					first = (int)v;
+				else if( c >= 2 )
+				{
+					mesh.faces.push_back( first );
+					mesh.faces.push_back( last );
+					mesh.faces.push_back( (int)v );
+				}
+				last = (int)v;
+			}
+		}
+		vertexBase += chunk.vertices.size();
+		normalBase += chunk.normals.size();
+	}
+
+	if( keepNormals )
+	{
+		mesh.normals.resize( vertexTotal, glm::dvec3( 0.0, 0.0, 1.0 ) );
+		for( size_t v = 0; v < vertexTotal; v++ )
+			if( normalOf[v] >= 0 )
+				mesh.normals[v] = normals[normalOf[v]];
+	}
+}
+
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+const int plySize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+bool plyType( const string& name, int& type )
+{
+	static const char* names[][2] = {
+		{ "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+		{ "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+	};
+	for( type = 0; type < 8; type++ )
+		if( name == names[type][0] || name == names[type][1] ) return true;
+	return false;
+}
+
+struct PlyProperty {
+	string name;
+	int type;
+	int countType;		// of a list property
+	bool list;
+};
+
+struct PlyElement {
+	string name;
+	long count;
+	vector<PlyProperty> properties;
+};
+
+// Reads the values of the data section one at a time, whatever the format.
+class PlyReader {
+public:
+	PlyReader( const char* p, const char* end, int format )
+		: p( p ), end( end ), format( format )
+	{
+		unsigned short one = 1;
+		bool littleHost = *(unsigned char*)&one == 1;
+		swap = format != PLY_ASCII && ( format == PLY_BINARY_LE ) != littleHost;
+	}
+
+	// bytes of the data section not read yet
+	size_t remaining() const { return end - p; }
+
+	double read( int type )
+	{
+		if( format == PLY_ASCII )
+		{
+			while( p < end && isspace( *p ) ) p++;
+			const char* last = p;
+			while( last < end && !isspace( *last ) ) last++;
+			double value;
+			if( last == p || Tokenizer::ScanScalar( p, last, value ) != last )
+				throw MeshFileException( p == end ? "data ends early" : "bad number in data" );
+			p = last;
+			return value;
+		}
+
+		int size = plySize[type];
+		if( end - p < size ) throw MeshFileException( "data ends early" );
+		unsigned char bytes[8];
+		memcpy( bytes, p, size );
+		p += size;
+		if( swap ) std::reverse( bytes, bytes + size );
+		switch( type )
+		{
+			case PLY_INT8:    { signed char v;    memcpy( &v, bytes, 1 ); return v; }
+			case PLY_UINT8:   { unsigned char v;  memcpy( &v, bytes, 1 ); return v; }
+			case PLY_INT16:   { short v;          memcpy( &v, bytes, 2 ); return v; }
+			case PLY_UINT16:  { unsigned short v; memcpy( &v, bytes, 2 ); return v; }
+			case PLY_INT32:   { int v;            memcpy( &v, bytes, 4 ); return v; }
+			case PLY_UINT32:  { unsigned int v;   memcpy( &v, bytes, 4 ); return v; }
+			case PLY_FLOAT32: { float v;          memcpy( &v, bytes, 4 ); return v; }
+			default:          { double v;         memcpy( &v, bytes, 8 ); return v; }
+		}
+	}
+
+private:
+	const char* p;
+	const char* end;
+	int format;
+	bool swap;
+};
+
+void readPly( const char* data, size_t size, MeshFile& mesh )
+{
+	const char* end = data + size;
+	const char* p = data;
+	int format = -1;
+	vector<PlyElement> elements;
+	for( ;; )
+	{
+		const char* eol = (const char*)memchr( p, '\n', end - p );
+		if( !eol ) throw MeshFileException( "header has no end_header" );
+		istringstream line( string( p, eol ) );
+		p = eol + 1;
+		string word;
+		line >> word;
+		if( word == "end_header" ) break;
+		if( word == "format" )
+		{
+			line >> word;
+			if( word == "ascii" ) format = PLY_ASCII;
+			else if( word == "binary_little_endian" ) format = PLY_BINARY_LE;
+			else if( word == "binary_big_endian" ) format = PLY_BINARY_BE;
+			else throw MeshFileException( "unknown format '" + word + "'" );
+		}
+		else if( word == "element" )
+		{
+			PlyElement element;
+			if( !( line >> element.name >> element.count ) || element.count < 0 )
+				throw MeshFileException( "bad element in header" );
+			elements.push_back( element );
+		}
+		else if( word == "property" )
+		{
+			PlyProperty property;
+			string type, countType;
+			line >> type;
+			property.list = type == "list";
+			if( property.list ) line >> countType >> type;
+			line >> property.name;
+			if( elements.empty() || !line || !plyType( type, property.type ) ||
+				( property.list && !plyType( countType, property.countType ) ) )
+				throw MeshFileException( "bad property in header" );
+			elements.back().properties.push_back( property );
+		}
+		// "ply", comments and obj_info lines need nothing
+	}
+	if( format < 0 ) throw MeshFileException( "header has no format" );
+
+	PlyReader reader( p, end, format );
+	for( size_t e = 0; e < elements.size(); e++ )
+	{
+		const PlyElement& element = elements[e];
+		const vector<PlyProperty>& properties = element.properties;
+		bool vertices = element.name == "vertex";
+		bool faces = element.name == "face";
+
+		// where each property goes: 0-5 for x, y, z, nx, ny, nz of a
+		// vertex, 6 for the index list of a face, -1 for nowhere
+		static const char* slotNames[] = { "x", "y", "z", "nx", "ny", "nz" };
+		vector<int> slots( properties.size(), -1 );
+		int normalSlots = 0;
+		for( size_t k = 0; k < properties.size(); k++ )
+		{
+			if( vertices && !properties[k].list )
+				for( int s = 0; s < 6; s++ )
+					if( properties[k].name == slotNames[s] )
+					{
+						slots[k] = s;
+						if( s >= 3 ) normalSlots++;
+					}
+			if( faces && properties[k].list &&
+				( properties[k].name == "vertex_indices" || properties[k].name == "vertex_index" ) )
+				slots[k] = 6;
+		}
+		// the header's count is only trusted as far as the file could hold
+		// that many elements, at a byte or more each
+		size_t expected = std::min( (size_t)element.count, reader.remaining() );
+		if( vertices )
+		{
+			mesh.vertices.reserve( expected );
+			if( normalSlots == 3 ) mesh.normals.reserve( expected );
+		}
+		if( faces ) mesh.faces.reserve( 3 * expected );
+
+		for( long i = 0; i < element.count; i++ )
+		{
+			double values[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+			for( size_t k = 0; k < properties.size(); k++ )
+			{
+				const PlyProperty& property = properties[k];
+				if( !property.list )
+				{
+					double value = reader.read( property.type );
+					if( slots[k] >= 0 ) values[slots[k]] = value;
+					continue;
+				}
+				int n = (int)reader.read( property.countType );
+				if( slots[k] == 6 && n < 3 ) throw MeshFileException( "face with fewer than 3 vertices" );
+				int first = 0, last = 0;
+				for( int c = 0; c < n; c++ )
+				{
+					int v = (int)reader.read( property.type );
+					if( slots[k] != 6 ) continue;
+					if( c == 0 )
+						first = v;
+					else if( c >= 2 )
+					{
+						mesh.faces.push_back( first );
+						mesh.faces.push_back( last );
+						mesh.faces.push_back( v );
+					}
+					last = v;
+				}
+			}
+			if( vertices )
+			{
+				mesh.vertices.push_back( glm::dvec3( values[0], values[1], values[2] ) );
+				if( normalSlots == 3 ) mesh.normals.push_back( glm::dvec3( values[3], values[4], values[5] ) );
+			}
+		}
+	}
+}
+
+}
+
+void readMeshFile( const string& path, MeshFile& mesh, ThreadPool* pool )
+{
+	MappedFile file;
+	if( !file.open( path ) )
+		throw MeshFileException( "cannot read '" + path + "'" );
+
+	mesh.vertices.clear();
+	mesh.normals.clear();
+	mesh.faces.clear();
+	const char* data = file.data();
+	size_t size = file.size();
+	if( size >= 4 && 0 == memcmp( data, "ply", 3 ) && ( '\n' == data[3] || '\r' == data[3] ) )
+		readPly( data, size, mesh );
+	else
+		readObj( data, size, mesh, pool );
+}
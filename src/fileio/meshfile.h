@@ -0,0 +1,43 @@
+//
+// meshfile.h
+//
+// Loading triangle meshes from OBJ and PLY files.
+//
+
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+class ThreadPool;
+
+class MeshFileException {
+	public:
+		MeshFileException( std::string errorMsg ) : _errorMsg( errorMsg ) {}
+		std::string message() { return _errorMsg; }
+
+	private:
+		std::string _errorMsg;
+};
+
+// A mesh as read from a file, in the form Trimesh takes it.
+struct MeshFile {
+	std::vector<glm::dvec3> vertices;
+	std::vector<glm::dvec3> normals;	// one per vertex, or none
+	std::vector<int> faces;			// three vertex indices per triangle
+};
+
+// Read a Wavefront OBJ file or a PLY file (ASCII, or binary of either byte
+// order), telling them apart by the "ply" magic at the start.  The file is
+// memory mapped.  Polygons are fan triangulated; texture coordinates,
+// groups and materials are ignored.  OBJ normals are kept if every corner
+// of a vertex uses the same one, which is how most exporters write them,
+// and dropped otherwise.  Large OBJ files are parsed in chunks on pool when
+// it is given.  Throws MeshFileException if the file cannot be read or
+// parsed.
+void readMeshFile( const std::string& path, MeshFile& mesh, ThreadPool* pool );
+
+#endif
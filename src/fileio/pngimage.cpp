@@ -5,13 +5,6 @@
 #  define png_jmpbuf(png_ptr)   ((png_ptr)->jmpbuf)
 #endif
 
-static png_structp png_ptr = NULL;
-static png_infop info_ptr = NULL;
-
-png_uint_32  width, height;
-int  bit_depth, color_type;
-uch  *image_data = NULL;
-
 void png_version_info(void) {
 
 	fprintf(stderr, "   Compiled with libpng %s; using libpng %s.\n",
@@ -22,29 +15,31 @@ void png_version_info(void) {
 
 /* return value = 0 for success, 1 for bad sig, 2 for bad IHDR, 4 for no mem, 8 for file open failure */
 
-int png_init(const char* filename, int &pWidth, int &pHeight) {
+int png_init(PngReader &reader, const char* filename, int &pWidth, int &pHeight) {
 	
 	uch sig[8];
 	FILE *infile;
 
 	if ((infile = fopen(filename, "rb")) == NULL) return (8);
+	reader.infile = infile;
 
 	/* check that the file really is a PNG image; could
 	* have used slightly more general png_sig_cmp() function instead */
 
-	fread(sig, 1, 8, infile);
-	if (png_sig_cmp(sig, 0, 8) != 0) return 1;   /* bad signature */
+	if (fread(sig, 1, 8, infile) != 8 || png_sig_cmp(sig, 0, 8) != 0) return 1;   /* bad signature */
 
 	/* could pass pointers to user-defined error handlers instead of NULLs: */
 
-	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png_ptr) return 4;   /* out of memory */
+	reader.png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!reader.png_ptr) return 4;   /* out of memory */
+	png_structp png_ptr = reader.png_ptr;
 
-	info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr) {
-		png_destroy_read_struct(&png_ptr, NULL, NULL);
+	reader.info_ptr = png_create_info_struct(png_ptr);
+	if (!reader.info_ptr) {
+		png_destroy_read_struct(&reader.png_ptr, NULL, NULL);
 		return 4;   /* out of memory */
 	}
+	png_infop info_ptr = reader.info_ptr;
 
 	/* we could create a second info struct here (end_info), but it's only
 	* useful if we want to keep pre- and post-IDAT chunk info separated
@@ -54,7 +49,7 @@ int png_init(const char* filename, int &pWidth, int &pHeight) {
 	* libpng function */
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		png_destroy_read_struct(&reader.png_ptr, &reader.info_ptr, NULL);
 		return 2;
 	}
 
@@ -67,9 +62,10 @@ int png_init(const char* filename, int &pWidth, int &pHeight) {
 	* etc., but want bit_depth and color_type for later [don't care about
 	* compression_type and filter_type => NULLs] */
 
-	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
-	pWidth = (int)width;
-	pHeight = (int)height;
+	png_get_IHDR(png_ptr, info_ptr, &reader.width, &reader.height, &reader.bit_depth,
+		&reader.color_type, NULL, NULL, NULL);
+	pWidth = (int)reader.width;
+	pHeight = (int)reader.height;
 
 	/* OK, that's all we need for now; return happy */
 
@@ -79,15 +75,19 @@ int png_init(const char* filename, int &pWidth, int &pHeight) {
 /* returns 0 if succeeds, 1 if fails due to no bKGD chunk, 2 if libpng error;
 * scales values to 8-bit if necessary */
 
-int png_get_bgcolor(uch *red, uch *green, uch *blue) {
+int png_get_bgcolor(PngReader &reader, uch *red, uch *green, uch *blue) {
 
+	png_structp png_ptr = reader.png_ptr;
+	png_infop info_ptr = reader.info_ptr;
+	int bit_depth = reader.bit_depth;
+	int color_type = reader.color_type;
 	png_color_16p pBackground;
 
 	/* setjmp() must be called in every function that calls a PNG-reading
 	* libpng function */
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		png_destroy_read_struct(&reader.png_ptr, &reader.info_ptr, NULL);
 		return 2;
 	}
 
@@ -125,8 +125,13 @@ int png_get_bgcolor(uch *red, uch *green, uch *blue) {
 
 /* display_exponent == LUT_exponent * CRT_exponent */
 
-uch *png_get_image(double display_exponent, int &pChannels, int &pRowbytes) {
+uch *png_get_image(PngReader &reader, double display_exponent, int &pChannels, int &pRowbytes) {
 
+	png_structp png_ptr = reader.png_ptr;
+	png_infop info_ptr = reader.info_ptr;
+	png_uint_32 height = reader.height;
+	int bit_depth = reader.bit_depth;
+	int color_type = reader.color_type;
 	double  gamma;
 	png_uint_32  i, rowbytes;
 	png_bytepp  row_pointers = NULL;
@@ -135,7 +140,7 @@ uch *png_get_image(double display_exponent, int &pChannels, int &pRowbytes) {
 	* libpng function */
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		png_destroy_read_struct(&reader.png_ptr, &reader.info_ptr, NULL);
 		return NULL;
 	}
 
@@ -170,18 +175,20 @@ uch *png_get_image(double display_exponent, int &pChannels, int &pRowbytes) {
 	pRowbytes = rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 	pChannels = (int)png_get_channels(png_ptr, info_ptr);
 
+	uch *image_data;
 	if ((image_data = (uch *)malloc(rowbytes*height)) == NULL) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		png_destroy_read_struct(&reader.png_ptr, &reader.info_ptr, NULL);
 		return NULL;
 	}
+	reader.image_data = image_data;
 	if ((row_pointers = (png_bytepp)malloc(height*sizeof(png_bytep))) == NULL) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		png_destroy_read_struct(&reader.png_ptr, &reader.info_ptr, NULL);
 		free(image_data);
-		image_data = NULL;
+		reader.image_data = NULL;
 		return NULL;
 	}
 
-	Trace((stderr, "readpng_get_image:  channels = %d, rowbytes = %ld, height = %ld\n", *pChannels, rowbytes, height));
+	Trace((stderr, "readpng_get_image:  channels = %d, rowbytes = %ld, height = %ld\n", pChannels, rowbytes, height));
 
 	/* set the individual row_pointers to point at the correct offsets */
 
@@ -202,16 +209,21 @@ uch *png_get_image(double display_exponent, int &pChannels, int &pRowbytes) {
 	return image_data;
 }
 
-void png_cleanup(int free_image_data) {
+void png_cleanup(PngReader &reader, int free_image_data) {
 
-	if (free_image_data && image_data) {
-		free(image_data);
-		image_data = NULL;
+	if (free_image_data && reader.image_data) {
+		free(reader.image_data);
+		reader.image_data = NULL;
+	}
+
+	if (reader.png_ptr) {
+		png_destroy_read_struct(&reader.png_ptr, reader.info_ptr ? &reader.info_ptr : NULL, NULL);
+		reader.png_ptr = NULL;
+		reader.info_ptr = NULL;
 	}
 
-	if (png_ptr && info_ptr) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		png_ptr = NULL;
-		info_ptr = NULL;
+	if (reader.infile) {
+		fclose(reader.infile);
+		reader.infile = NULL;
 	}
 }
@@ -1,3 +1,6 @@
+#ifndef PNGIMAGE_H
+#define PNGIMAGE_H
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -15,15 +18,35 @@ typedef unsigned short  ush;
 typedef unsigned long   ulg;
 
 
+/* The state of one PNG file being read: png_init() fills it in and
+ * png_cleanup() releases it.  Readers share nothing, so different files
+ * can be read on different threads at the same time. */
+
+struct PngReader {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	FILE *infile;
+	png_uint_32 width, height;
+	int bit_depth, color_type;
+	uch *image_data;
+
+	PngReader()
+		: png_ptr(NULL), info_ptr(NULL), infile(NULL), width(0), height(0),
+		bit_depth(0), color_type(0), image_data(NULL) {}
+};
+
+
 /* prototypes for public functions in readpng.c */
 
 void png_version_info(void);
 
-int png_init(const char* filename, int &pWidth, int &pHeight);
+int png_init(PngReader &reader, const char* filename, int &pWidth, int &pHeight);
 
-int png_get_bgcolor(uch *bg_red, uch *bg_green, uch *bg_blue);
+int png_get_bgcolor(PngReader &reader, uch *bg_red, uch *bg_green, uch *bg_blue);
 
-uch *png_get_image(double display_exponent, int &pChannels,
+uch *png_get_image(PngReader &reader, double display_exponent, int &pChannels,
                        int &pRowbytes);
 
-void png_cleanup(int free_image_data);
+void png_cleanup(PngReader &reader, int free_image_data);
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "Parser.h"
 #include "Tokenizer.h"
+#include "../fileio/meshfile.h"
 #include "../scene/scene.h"
 #include "../scene/material.h"
 #include "../ui/TraceUI.h"
@@ -28,17 +29,18 @@ Scene* Parser::parseScene()
 {
   _tokenizer.Read(SBT_RAYTRACER);
 
-  unique_ptr<Token> versionNumber( _tokenizer.Read(SCALAR) );
+  Token versionNumber( _tokenizer.Read(SCALAR) );
 
-  if( versionNumber->value() > 1.1 )
+  if( versionNumber.value() > 1.1 )
   {
     ostringstream ost;
-    ost << "SBT-raytracer version number " << versionNumber->value() << 
+    ost << "SBT-raytracer version number " << versionNumber.value() << 
       " too high; only able to parse v1.1 and below.";
     throw ParserException( ost.str() );
   }
 
   Scene* scene = new Scene;
+  scene->setThreadPool( _pool );
   unique_ptr<Material> mat( new Material );
 
   for( ;; )
@@ -547,6 +549,10 @@ void Parser::parseCone(Scene* scene, TransformNode* transform, const Material& m
   }
 }
 
+static const char* const MESH_FILE_NORMALS =
+  "Bad Trimesh: points and normals from mesh_file and those given inline "
+  "don't line up; give normals for all of them or for none.";
+
 void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material& mat)
 {
   Trimesh* tmesh = new Trimesh( scene, new Material(mat), transform);
@@ -555,7 +561,13 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
   _tokenizer.Read( LBRACE );
 
   bool generateNormals( false );
-  list<glm::dvec3> faces;
+  bool hasVertices( false );
+  bool hasMeshFile( false );
+  // the last geometry attribute seen, which an instance may not have
+  const char* geometry = 0;
+  string name;
+  // three vertex indices per triangle
+  vector<int> faces;
 
   const char* error;
   for( ;; )
@@ -568,6 +580,7 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
         _tokenizer.Read( GENNORMALS );
         _tokenizer.Read( SEMICOLON );
         generateNormals = true;
+        geometry = "gennormals";
         break;
 
       case MATERIAL:
@@ -575,10 +588,11 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
         break;
 
       case NAME:
-         parseIdentExpression();
+         name = parseIdentExpression();
          break;
 
       case MATERIALS:
+        geometry = "materials";
         _tokenizer.Read( MATERIALS );
         _tokenizer.Read( EQUALS );
         _tokenizer.Read( LPAREN );
@@ -599,62 +613,44 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
         break;
 
       case NORMALS:
+        geometry = "normals";
         _tokenizer.Read( NORMALS );
         _tokenizer.Read( EQUALS );
-        _tokenizer.Read( LPAREN );
-        if( RPAREN != _tokenizer.Peek()->kind() )
-        {
-          tmesh->addNormal( parseVec3d() );
-          for( ;; )
-          {
-             const Token* nextToken = _tokenizer.Peek();
-             if( RPAREN == nextToken->kind() )
-               break;
-             _tokenizer.Read( COMMA );
-             tmesh->addNormal( parseVec3d() );
-          }
-        }
-        _tokenizer.Read( RPAREN );
+        parseVec3dList( tmesh, &Trimesh::addNormal );
         _tokenizer.Read( SEMICOLON );
         break;
 
       case FACES:
+        geometry = "faces";
         _tokenizer.Read( FACES );
         _tokenizer.Read( EQUALS );
         _tokenizer.Read( LPAREN );
-        if( RPAREN != _tokenizer.Peek()->kind() )
+        if( !_tokenizer.CondRead( RPAREN ) )
         {
-          parseFaces( faces );
-          for( ;; )
-          {
-             const Token* nextToken = _tokenizer.Peek();
-             if( RPAREN == nextToken->kind() )
-               break;
-             _tokenizer.Read( COMMA );
-             parseFaces( faces );
-          }
+          do
+            parseFaces( faces );
+          while( _tokenizer.CondRead( COMMA ) );
+          _tokenizer.Read( RPAREN );
         }
-        _tokenizer.Read( RPAREN );
         _tokenizer.Read( SEMICOLON );
         break;
 
+      case MESH_FILE:
+      {
+        string filename = _basePath;
+        filename.append( "/" );
+        filename.append( parseIdentExpression() );
+        parseMeshFile( tmesh, filename, faces );
+        hasVertices = true;
+        hasMeshFile = true;
+        break;
+      }
+
       case POLYPOINTS:
         _tokenizer.Read( POLYPOINTS );
         _tokenizer.Read( EQUALS );
-        _tokenizer.Read( LPAREN );
-        if( RPAREN != _tokenizer.Peek()->kind() )
-        {
-          tmesh->addVertex( parseVec3d() );
-          for( ;; )
-          {
-             const Token* nextToken = _tokenizer.Peek();
-             if( RPAREN == nextToken->kind() )
-               break;
-             _tokenizer.Read( COMMA );
-             tmesh->addVertex( parseVec3d() );
-          }
-        }
-        _tokenizer.Read( RPAREN );
+        hasVertices = true;
+        parseVec3dList( tmesh, &Trimesh::addVertex );
         _tokenizer.Read( SEMICOLON );
         break;
 
@@ -663,15 +659,39 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
       {
         _tokenizer.Read( RBRACE );
 
+        // A named trimesh without geometry of its own is another instance
+        // of the mesh defined earlier under that name.  Only its material
+        // and transform may differ from the original.
+        if( !hasVertices && !name.empty() )
+        {
+          if( geometry )
+          {
+            ostringstream oss;
+            oss << "Trimesh '" << name << "' is an instance; it cannot take " << geometry << ".";
+            throw SyntaxErrorException( oss.str(), _tokenizer );
+          }
+          meshmap::const_iterator m = meshes.find( name );
+          if( m == meshes.end() )
+          {
+            ostringstream oss;
+            oss << "Unknown trimesh '" << name << "'.";
+            throw SyntaxErrorException( oss.str(), _tokenizer );
+          }
+          tmesh->shareMesh( m->second );
+          scene->add( tmesh );
+          return;
+        }
+
         // Now add all the faces into the trimesh, since hopefully
         // the vertices have been parsed out
-        for( list<glm::dvec3>::const_iterator vitr = faces.begin(); vitr != faces.end(); vitr++ )
+        tmesh->reserveFaces( (int)faces.size() / 3 );
+        for( size_t f = 0; f < faces.size(); f += 3 )
         {
-          if( !tmesh->addFace( (*vitr)[0], (*vitr)[1], (*vitr)[2] ) )
+          if( !tmesh->addFace( faces[f], faces[f + 1], faces[f + 2] ) )
           {
             ostringstream oss;
-            oss << "Bad face in trimesh: (" << (*vitr)[0] << ", " << (*vitr)[1] << 
-              ", " << (*vitr)[2] << ")";
+            oss << "Bad face in trimesh: (" << faces[f] << ", " << faces[f + 1] << 
+              ", " << faces[f + 2] << ")";
             throw ParserException( oss.str() );
           }
         }
@@ -679,9 +699,24 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
         if( generateNormals )
           tmesh->generateNormals();
 
-        if( error = tmesh->doubleCheck() )
+        if( hasMeshFile && !tmesh->getMesh()->normals.empty() &&
+            tmesh->getMesh()->normals.size() != tmesh->getMesh()->vertices.size() )
+          throw ParserException( MESH_FILE_NORMALS );
+
+        if( ( error = tmesh->doubleCheck() ) )
           throw ParserException( error );
 
+        tmesh->buildBVH();
+        if( ! name.empty() )
+        {
+          if( meshes.find( name ) != meshes.end() )
+          {
+            ostringstream oss;
+            oss << "Redefinition of trimesh '" << name << "'.";
+            throw SyntaxErrorException( oss.str(), _tokenizer );
+          }
+          meshes[ name ] = tmesh->getMesh();
+        }
         scene->add( tmesh );
         return;
       }
@@ -692,22 +727,87 @@ void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material
   }
 }
 
-void Parser::parseFaces( list< glm::dvec3 >& faces )
+// Add the vertices and normals of an OBJ or PLY file to tmesh and its
+// triangles to faces, numbered after any vertices tmesh already has.
+// Normals are per vertex, so tmesh and the file must either both have
+// them or both lack them.
+void Parser::parseMeshFile( Trimesh* tmesh, const string& filename, vector<int>& faces )
 {
-  list< double > points = parseScalarList();
+  MeshFile file;
+  try
+  {
+    readMeshFile( filename, file, _pool );
+  }
+  catch( MeshFileException& e )
+  {
+    throw ParserException( "Mesh file " + filename + ": " + e.message() );
+  }
+  _dependencies.push_back( filename );
+
+  const TrimeshData& mesh = *tmesh->getMesh();
+  int base = (int)mesh.vertices.size();
+  if( ( !file.normals.empty() && (int)mesh.normals.size() != base ) ||
+      ( !mesh.normals.empty() && file.normals.size() != file.vertices.size() ) )
+    throw ParserException( MESH_FILE_NORMALS );
+
+  for( size_t k = 0; k < file.vertices.size(); k++ )
+    tmesh->addVertex( file.vertices[k] );
+  for( size_t k = 0; k < file.normals.size(); k++ )
+    tmesh->addNormal( file.normals[k] );
+  faces.reserve( faces.size() + file.faces.size() );
+  for( size_t k = 0; k < file.faces.size(); k++ )
+    faces.push_back( base + file.faces[k] );
+}
+
+// Parse "( (x, y, z), (x, y, z), ... )" and hand each vector to add.
+// Vectors are read straight from the text when they are plain numbers
+// (see Tokenizer::ScanTuple()), and token by token otherwise.
+void Parser::parseVec3dList( Trimesh* tmesh, void (Trimesh::*add)( const rvec3& ) )
+{
+  _tokenizer.Read( LPAREN );
+  if( _tokenizer.CondRead( RPAREN ) )
+    return;
+  do
+  {
+    double v[3];
+    if( _tokenizer.ScanTuple( v, 3 ) == 3 )
+      (tmesh->*add)( rvec3( v[0], v[1], v[2] ) );
+    else
+      (tmesh->*add)( parseVec3d() );
+  }
+  while( _tokenizer.CondRead( COMMA ) );
+  _tokenizer.Read( RPAREN );
+}
+
+void Parser::parseFaces( vector<int>& faces )
+{
+  // faces of up to 16 vertices are read straight from the text; longer
+  // ones take the token path
+  double fast[16];
+  const double* points = fast;
+  vector<double> slow;
+  int count = _tokenizer.ScanTuple( fast, 16 );
+  if( count < 0 )
+  {
+    list<double> scalars = parseScalarList();
+    slow.assign( scalars.begin(), scalars.end() );
+    points = slow.data();
+    count = (int)slow.size();
+  }
 
   // triangulate here and now.  assume the poly is
   // concave (convex?) and we can triangulate using an arbitrary fan
-  if( points.size() < 3 )
+  if( count < 3 )
      throw SyntaxErrorException( "Faces must have at least 3 vertices.", _tokenizer );
 
-  list<double>::const_iterator i = points.begin();
-  double a = (*i++);
-  double b = (*i++);
-  while( i != points.end() )
+  int a = (int)points[0];
+  int b = (int)points[1];
+  for( int k = 2; k < count; k++ )
   {
-    double c = (*i++);
-    faces.push_back( glm::dvec3( a, b, c ) );
+    int c = (int)points[k];
+    faces.push_back( a );
+    faces.push_back( b );
+    faces.push_back( c );
     b = c;
   }
 }
@@ -894,16 +994,16 @@ string Parser::parseIdentExpression()
 
 double Parser::parseScalar()
 {
-  unique_ptr<Token> scalar( _tokenizer.Read( SCALAR ) );
+  Token scalar( _tokenizer.Read( SCALAR ) );
 
-  return scalar->value();
+  return scalar.value();
 }
 
 string Parser::parseIdent()
 {
-  unique_ptr<Token> scalar( _tokenizer.Read( IDENT ) );
+  Token scalar( _tokenizer.Read( IDENT ) );
 
-  return scalar->ident();
+  return scalar.ident();
 }
 
 
@@ -949,34 +1049,34 @@ bool Parser::parseBoolean()
 glm::dvec3 Parser::parseVec3d()
 {
   _tokenizer.Read( LPAREN );
-  unique_ptr<Token> value1( _tokenizer.Read( SCALAR ) );
+  Token value1( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( COMMA );
-  unique_ptr<Token> value2( _tokenizer.Read( SCALAR ) );
+  Token value2( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( COMMA );
-  unique_ptr<Token> value3( _tokenizer.Read( SCALAR ) );
+  Token value3( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( RPAREN );
 
-  return glm::dvec3( value1->value(), 
-    value2->value(), 
-    value3->value() );
+  return glm::dvec3( value1.value(), 
+    value2.value(), 
+    value3.value() );
 }
 
 glm::dvec4 Parser::parseVec4d()
 {
   _tokenizer.Read( LPAREN );
-  unique_ptr<Token> value1( _tokenizer.Read( SCALAR ) );
+  Token value1( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( COMMA );
-  unique_ptr<Token> value2( _tokenizer.Read( SCALAR ) );
+  Token value2( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( COMMA );
-  unique_ptr<Token> value3( _tokenizer.Read( SCALAR ) );
+  Token value3( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( COMMA );
-  unique_ptr<Token> value4( _tokenizer.Read( SCALAR ) );
+  Token value4( _tokenizer.Read( SCALAR ) );
   _tokenizer.Read( RPAREN );
 
-  return glm::dvec4( value1->value(), 
-    value2->value(), 
-    value3->value(),
-    value4->value() );
+  return glm::dvec4( value1.value(), 
+    value2.value(), 
+    value3.value(),
+    value4.value() );
 }
 
 Material* Parser::parseMaterial( Scene* scene, const Material& parent )
@@ -989,7 +1089,6 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
 
   _tokenizer.Read( LBRACE );
 
-  bool setReflective( false );
   string name;
 
   Material* mat = new Material(parent);
@@ -1008,13 +1107,8 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
         break;
 
       case SPECULAR:
-      {
-        MaterialParameter specular = parseVec3dMaterialParameter(scene);
-        mat->setSpecular( specular );
-//        if( ! setReflective )
-//          mat->setReflective( specular );  // Default kr = ks if none specified
+        mat->setSpecular( parseVec3dMaterialParameter(scene) );
         break;
-      }
 
       case DIFFUSE:
         mat->setDiffuse( parseVec3dMaterialParameter(scene) ); 
@@ -1022,7 +1116,6 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
 
       case REFLECTIVE:
         mat->setReflective( parseVec3dMaterialParameter(scene) );
-        setReflective = true;
         break;
 
       case TRANSMISSIVE:
@@ -1039,7 +1132,7 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
 
       case NAME:
          _tokenizer.Read(NAME);
-         name = (_tokenizer.Read(IDENT))->ident();
+         name = _tokenizer.Read(IDENT).ident();
          _tokenizer.Read( SEMICOLON );
          break;
 
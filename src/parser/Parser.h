@@ -19,10 +19,13 @@
 #include "../SceneObjects/Square.h"
 #include "../SceneObjects/trimesh.h"
 
+#include "../ThreadPool.h"
+
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
 typedef std::map<string,Material> mmap;
+typedef std::map<string,std::shared_ptr<TrimeshData> > meshmap;
 
 /*
   class Parser:
@@ -42,13 +45,18 @@ class Parser
   public:
     // We need the path for referencing files from the
     // base file.
-    Parser( Tokenizer& tokenizer, string basePath )
-      : _tokenizer( tokenizer ), _basePath( basePath )
+    // Large mesh files are parsed on pool, if it is given.
+    Parser( Tokenizer& tokenizer, string basePath, ThreadPool* pool = 0 )
+      : _tokenizer( tokenizer ), _basePath( basePath ), _pool( pool )
       { }
 
     // Parse the top-level scene
     Scene* parseScene();
 
+    // Files other than the scene file itself that the scene was built
+    // from (mesh files), in the order they were read.
+    const std::vector<string>& dependencies() const { return _dependencies; }
+
 private:
 
     // Highest level parsing routines
@@ -71,7 +79,9 @@ private:
     void      parseCylinder(Scene* scene, TransformNode* transform, const Material& mat);
     void      parseCone(Scene* scene, TransformNode* transform, const Material& mat);
     void      parseTrimesh(Scene* scene, TransformNode* transform, const Material& mat);
-    void      parseFaces( std::list< glm::dvec3 >& faces );
+    void      parseFaces( std::vector<int>& faces );
+    void      parseMeshFile( Trimesh* tmesh, const string& filename, std::vector<int>& faces );
+    void      parseVec3dList( Trimesh* tmesh, void (Trimesh::*add)( const rvec3& ) );
 
     // Parse transforms
     void parseTranslate(Scene* scene, TransformNode* transform, const Material& mat);
@@ -105,7 +115,10 @@ private:
   private:
     Tokenizer& _tokenizer;
     mmap materials;
+    meshmap meshes;
     std::string _basePath;
+    ThreadPool* _pool;
+    std::vector<string> _dependencies;
 };
 
 #endif
@@ -72,6 +72,7 @@ string getNameForToken( const SYMBOL kind )
     tokenNames[ NORMALS ]           = "normals";
     tokenNames[ MATERIALS ]         = "materials";
     tokenNames[ FACES ]             = "faces";
+    tokenNames[ MESH_FILE ]         = "mesh_file";
     tokenNames[ TRANSLATE ]         = "translate";
     tokenNames[ SCALE ]             = "scale";
     tokenNames[ ROTATE ]            = "rotate";
@@ -139,6 +140,7 @@ SYMBOL lookupReservedWord(const string& ident) {
     reservedWords["index"] = INDEX;
     reservedWords["linear_attenuation_coeff"] = LINEAR_ATTENUATION_COEFF;
     reservedWords["material"] = MATERIAL;
+    reservedWords["mesh_file"] = MESH_FILE;
     reservedWords["materials"] = MATERIALS;
     reservedWords["map"] = MAP;
     reservedWords["name"] = NAME;
@@ -179,7 +181,13 @@ SYMBOL lookupReservedWord(const string& ident) {
 
 string Token::toString() const
 {
-  return getNameForToken( kind() );
+  ostringstream oss;
+  oss << getNameForToken( kind() );
+  if( IDENT == kind() )
+    oss << ": \"" << _ident << "\"";
+  else if( SCALAR == kind() )
+    oss << ": " << _value;
+  return oss.str();
 }
 
 void Token::Print( ostream& out ) const {
@@ -189,16 +197,3 @@ void Token::Print( ostream& out ) const {
 void Token::Print( ) const {
   Print( std::cout );
 }
-
-string IdentToken::toString( ) const {
-  ostringstream oss( Token::toString() );
-  oss << ": \"" << _ident << "\"";
-  return oss.str();
-}
-
-string ScalarToken::toString( ) const {
-  ostringstream oss( Token::toString() );
-  oss << ": " << _value;
-  return oss.str();
-}
- 
@@ -71,6 +71,7 @@ enum SYMBOL {
   POLYPOINTS, NORMALS,			// keywords affecting polygons
   MATERIALS, FACES,
   GENNORMALS,
+  MESH_FILE,
 
   TRANSLATE, SCALE,			// Transforms
   ROTATE, TRANSFORM,
@@ -88,53 +89,42 @@ enum SYMBOL {
 string getNameForToken( const SYMBOL kind );
 SYMBOL lookupReservedWord( const string& name );
 
+// Tokens are small values: the tokenizer hands them out by copy, so
+// scanning a long list of numbers allocates nothing.  Only identifiers
+// carry a string, and short ones fit in the string itself.
 class Token {
   public:
-    Token(SYMBOL kind) : _kind( kind ) { }
+    Token(SYMBOL kind = UNKNOWN) : _kind( kind ), _value( 0.0 ) { }
 
     SYMBOL kind() const { return _kind; }
 
     // Note that these errors should not ever be encountered at runtime,
     // and signify parser bugs of some kind.
-    virtual std::string ident() const   
-      { throw ParserFatalException("not an IdentToken"); return std::string(); }
-    virtual double value() const   
-      { throw ParserFatalException("not a ScalarToken"); return 0.0; }
+    std::string ident() const   
+      { if( IDENT != _kind ) throw ParserFatalException("not an IdentToken"); return _ident; }
+    double value() const   
+      { if( SCALAR != _kind ) throw ParserFatalException("not a ScalarToken"); return _value; }
 
 
     // Utility functions
-    virtual void Print(std::ostream& out) const;
-    virtual void Print() const;
-    virtual string toString() const;
+    void Print(std::ostream& out) const;
+    void Print() const;
+    string toString() const;
 
-	virtual ~Token() {}
   protected:
-    const SYMBOL _kind;
+    SYMBOL _kind;
+    double _value;
+    std::string _ident;
 };
 
 class IdentToken : public Token {
   public:
-    IdentToken(std::string ident) : Token(IDENT), _ident( ident ) { 
-    }
-
-    std::string ident() const { return _ident; }
-
-    string toString() const;
-
-  protected:
-    const std::string _ident;
+    IdentToken(const std::string& ident) : Token(IDENT) { _ident = ident; }
 };
 
 class ScalarToken : public Token {
   public:
-    ScalarToken(double value) : Token(SCALAR), _value( value ) { }
-    
-    double value() const { return _value; }
-
-    string toString() const;
-
-  protected:
-    const double _value;
+    ScalarToken(double value) : Token(SCALAR) { _value = value; }
 };
 
 
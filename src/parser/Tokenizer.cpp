@@ -41,7 +41,7 @@ Tokenizer::Tokenizer(istream& fp, bool printTokens)
 { 
     TokenColumn = 0;
     CurrentCh = ' ';
-    UnGetToken = NULL;
+    HaveUnGetToken = false;
     _printTokens = printTokens;
 }
 
@@ -51,30 +51,29 @@ Tokenizer::Tokenizer(istream& fp, bool printTokens)
 // last phase to be executed
 // 
 void Tokenizer::ScanProgram() {
-    while (Get()->kind() != EOFSYM) ;
+    while (Get().kind() != EOFSYM) ;
 }
 
 
-unique_ptr<Token> Tokenizer::Get() {
-  return unique_ptr<Token>(GetNext());
+Token Tokenizer::Get() {
+  return GetNext();
 }
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Token* Tokenizer::Get() method
+// Token Tokenizer::GetNext() method
 //
 // Advance through the source to find the next token. Returns peeked token,
 // if there is one.
 //
 
-Token* Tokenizer::GetNext() {
-  Token* T = NULL;
+Token Tokenizer::GetNext() {
+  Token T;
 
   // First check to see if there is an UnGetToken. If there is, use it.
-  if (UnGetToken != NULL) {
-    T = UnGetToken;
-    UnGetToken = NULL;
-    return T;
+  if (HaveUnGetToken) {
+    HaveUnGetToken = false;
+    return UnGetToken;
   }
 
   // Otherwise, crank up the scanner and get a new token.
@@ -84,7 +83,7 @@ Token* Tokenizer::GetNext() {
 
   // test for end of file
   if (buffer.isEOF()) {
-    T = new Token(EOFSYM);
+    T = Token(EOFSYM);
 
   } else {
     
@@ -111,13 +110,9 @@ Token* Tokenizer::GetNext() {
     }
   }
   
-  if (T == NULL) {
-    throw ParserFatalException("didn't get a token");
-  }
-
   if (_printTokens) {
     std::cout << "Token read: ";
-    T->Print();
+    T.Print();
     std::cout << std::endl;
   }
 
@@ -185,19 +180,22 @@ void Tokenizer::SkipWhiteSpace() {
   }
 }
 
-Token* Tokenizer::GetQuotedIdent() {
+Token Tokenizer::GetQuotedIdent() {
   GetCh();   // Throw out beginning '"'
 
-  std::ostringstream ident;
-  while ( '"' != CurrentCh ) {
-    if( '\n' == CurrentCh )
+  const char* first = buffer.Position();
+  const char* last = first;
+  while ( '"' != *last ) {
+    if( '\n' == *last ) {
+      CurrentCh = buffer.SkipTo( last );
       throw SyntaxErrorException( "Unterminated string constant", *this );
-
-    ident << CurrentCh;
-    GetCh();
+    }
+    last++;
   }
+  IdentToken T( string( first, last ) );
+  CurrentCh = buffer.SkipTo( last );
   GetCh();
-  return new IdentToken( ident.str() );
+  return T;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -208,32 +206,145 @@ Token* Tokenizer::GetQuotedIdent() {
 //   identifier or a reserved word token.
 //
 
-Token* Tokenizer::GetIdent() {
+Token Tokenizer::GetIdent() {
   // an IDENTIFIER or a RESERVED WORD token
-  std::ostringstream ident;
-  while (isalnum(CurrentCh) || '_' == CurrentCh || '-' == CurrentCh) { 
+  const char* first = buffer.Position();
+  const char* last = first;
+  while (isalnum(*last) || '_' == *last || '-' == *last) { 
     // While we still have something that can
-    ident << CurrentCh;
-    GetCh();
+    last++;
   }
-  return SearchReserved(ident.str());
+  CurrentCh = buffer.SkipTo( last );
+  return SearchReserved(string( first, last ));
 }
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Token* Tokenizer::GetInt method
+// Token Tokenizer::GetScalar method
 //
-//   GetInt scans an integer.  It returns an integer token.
+//   GetScalar scans a number.  It returns a scalar token.  Like atof, it
+//   takes the longest number at the front of the run of number characters
+//   and gives 0 if there is none.
 //
 
-Token* Tokenizer::GetScalar() {
-  // an INTEGER token
-  string ret( "" );
-  while (isdigit(CurrentCh) || '-' == CurrentCh || '.' == CurrentCh || 'e' == CurrentCh ) {
-    ret += CurrentCh;
-    GetCh();
+Token Tokenizer::GetScalar() {
+  const char* first = buffer.Position();
+  const char* last = first;
+  while (isdigit(*last) || '-' == *last || '.' == *last || 'e' == *last ) {
+    last++;
   }
-  return new ScalarToken( atof( ret.c_str() ) );
+  double value;
+  if (ScanScalar( first, last, value ) == first) value = 0.0;
+  CurrentCh = buffer.SkipTo( last );
+  return ScalarToken( value );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// int Tokenizer::ScanTuple(double*, int) method
+//
+//   ScanTuple scans ahead in the buffer without moving the current
+//   position, and only moves it past the tuple once the whole of it has
+//   been read.  A number must fill its whole run of number characters to
+//   be taken here; anything odd is left to GetScalar.
+//
+
+static const char* SkipSpace(const char* p) {
+  while (isspace(*p)) p++;
+  return p;
+}
+
+static bool IsScalarCh(char c) {
+  return isdigit(c) || '-' == c || '.' == c || 'e' == c;
+}
+
+int Tokenizer::ScanTuple(double* values, int max) {
+  if (HaveUnGetToken) return -1;
+  SkipWhiteSpace();
+  if ('(' != CurrentCh || buffer.isEOF()) return -1;
+
+  // the text ends in "\n\0", which stops every loop below
+  const char* p = buffer.Position() + 1;
+  int n = 0;
+  for (;;) {
+    p = SkipSpace(p);
+    const char* last = p;
+    while (IsScalarCh(*last)) last++;
+    if (n == max || last == p || ScanScalar(p, last, values[n]) != last) return -1;
+    n++;
+    p = SkipSpace(last);
+    if (')' == *p) break;
+    if (',' != *p) return -1;
+    p++;
+  }
+
+  TokenColumn = buffer.CurColumn();
+  CurrentCh = buffer.SkipTo(p + 1);
+  return n;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// const char* Tokenizer::ScanScalar(const char*, const char*, double&)
+//
+//   The digits are gathered into a 64-bit integer and scaled by an exact
+// power of ten.  When the integer fits in a double's 53 bit mantissa and
+// the power of ten is at most 10^22 (both exact in a double), a single
+// multiply or divide rounds correctly, which is the same answer strtod
+// gives.  Longer mantissas and larger exponents go to strtod instead.
+//
+
+const char* Tokenizer::ScanScalar(const char* first, const char* last, double& value) {
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char* p = first;
+  bool negative = p != last && '-' == *p;
+  if (negative) p++;
+
+  unsigned long long mantissa = 0;
+  int digits = 0;             // significant digits in mantissa
+  int scale = 0;              // power of ten to apply to mantissa
+  bool any = false;
+  bool exact = true;
+  for (; p != last && isdigit(*p); p++, any = true) {
+    if (digits == 0 && '0' == *p) continue;
+    if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; }
+    else { scale++; exact = false; }
+  }
+  if (p != last && '.' == *p) {
+    for (p++; p != last && isdigit(*p); p++, any = true) {
+      if (digits == 0 && '0' == *p) { scale--; continue; }
+      if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; scale--; }
+      else exact = false;
+    }
+  }
+  if (!any) return first;
+
+  // an exponent counts only if it has digits
+  if (p != last && ('e' == *p || 'E' == *p)) {
+    const char* q = p + 1;
+    bool negExp = q != last && '-' == *q;
+    if (q != last && ('-' == *q || '+' == *q)) q++;
+    if (q != last && isdigit(*q)) {
+      int exponent = 0;
+      for (; q != last && isdigit(*q); q++)
+        if (exponent < 100000) exponent = exponent * 10 + (*q - '0');
+      scale += negExp ? -exponent : exponent;
+      p = q;
+    }
+  }
+
+  if (exact && mantissa < (1ull << 53) && scale >= -22 && scale <= 22) {
+    double m = (double)mantissa;
+    value = scale < 0 ? m / powers[-scale] : m * powers[scale];
+  } else {
+    value = strtod( string( negative ? first + 1 : first, p ).c_str(), NULL );
+  }
+  if (negative) value = -value;
+  return p;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -243,17 +354,17 @@ Token* Tokenizer::GetScalar() {
 //   Gets a punctuation token from input stream and returns it.
 //
 
-Token* Tokenizer::GetPunct() {
-  Token* T;
+Token Tokenizer::GetPunct() {
+  Token T;
 
   switch (CurrentCh) {
-  case '(':  GetCh(); T = new Token(LPAREN);     break;
-  case ')':  GetCh(); T = new Token(RPAREN);     break;
-  case '{':  GetCh(); T = new Token(LBRACE);     break;
-  case '}':  GetCh(); T = new Token(RBRACE);     break;
-  case ',':  GetCh(); T = new Token(COMMA);      break;
-  case '=':  GetCh(); T = new Token(EQUALS);     break;
-  case ';':  GetCh(); T = new Token(SEMICOLON);  break;
+  case '(':  GetCh(); T = Token(LPAREN);     break;
+  case ')':  GetCh(); T = Token(RPAREN);     break;
+  case '{':  GetCh(); T = Token(LBRACE);     break;
+  case '}':  GetCh(); T = Token(RBRACE);     break;
+  case ',':  GetCh(); T = Token(COMMA);      break;
+  case '=':  GetCh(); T = Token(EQUALS);     break;
+  case ';':  GetCh(); T = Token(SEMICOLON);  break;
 
   default:
     std::ostringstream ost;
@@ -266,18 +377,18 @@ Token* Tokenizer::GetPunct() {
 
 //////////////////////////////////////////////////////////////////////////
 //
-// void Tokenizer::UnGet(Token*) method
+// void Tokenizer::UnGet(const Token&) method
 //
 //   UnGet returns the last read token to the input, where it will be
 //   returned for the next Get call.  At most 1 token can be pushed back
-//   at a time this way and this token is pointed to by the pointer
-//   TokenToUnGet.  TokenToUnGet must be non null.
+//   at a time this way and this token is kept in UnGetToken.
 
-void Tokenizer::UnGet(Token* TokenToUnGet) {
-  if (UnGetToken != NULL) {
+void Tokenizer::UnGet(const Token& TokenToUnGet) {
+  if (HaveUnGetToken) {
     throw ParserFatalException("trying to UnGet more than one token");
   }
   UnGetToken = TokenToUnGet;
+  HaveUnGetToken = true;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -288,21 +399,20 @@ void Tokenizer::UnGet(Token* TokenToUnGet) {
 //
 
 const Token* Tokenizer::Peek() {
-  Token* T = GetNext();
-  UnGet(T);
-  return T;
+  if (!HaveUnGetToken) UnGet(GetNext());
+  return &UnGetToken;
 }
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Token* Tokenizer::Read(SYMBOL) method
+// Token Tokenizer::Read(SYMBOL) method
 //
 //   Read gets the next token and checks that it's of the expected type.
 //
 
-unique_ptr<Token> Tokenizer::Read(SYMBOL kind) {
-  unique_ptr<Token> T( Get() );
-  if (T->kind() != kind) {
+Token Tokenizer::Read(SYMBOL kind) {
+  Token T( Get() );
+  if (T.kind() != kind) {
     string msg( getNameForToken( kind ) );
     msg.append( " expected" );
     throw SyntaxErrorException(msg, *this);
@@ -331,7 +441,7 @@ bool Tokenizer::CondRead(SYMBOL kind) {
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Token* Tokenizer::SearchReserved(const string&) private method
+// Token Tokenizer::SearchReserved(const string&) private method
 //
 //   SearchReserved() maps a character string to an IdentToken or one of
 // several possible reserved word tokens, using a binary search on the
@@ -345,15 +455,15 @@ bool Tokenizer::CondRead(SYMBOL kind) {
 
 typedef std::map<string, SYMBOL> ReservedWordsMap;
 
-Token* Tokenizer::SearchReserved(const string& ident) const {
+Token Tokenizer::SearchReserved(const string& ident) const {
   SYMBOL tokSymbol = lookupReservedWord( ident );
   if( UNKNOWN == tokSymbol )
   {
-    return new IdentToken( ident );
+    return IdentToken( ident );
   }
   else
   {
-    return new Token( tokSymbol );
+    return Token( tokSymbol );
   }
 }
 
@@ -6,14 +6,12 @@
 #include "../fileio/buffer.h"
 
 #include <string>
-#include <memory>
 
 // Needed to correct for annoying "feature" in MSVC's compiler
 #pragma warning (disable: 4786)
 
 using std::string;
 using std::istream;
-using std::unique_ptr;
 
 
 /*
@@ -34,13 +32,14 @@ class Tokenizer {
     Tokenizer(istream& fp, bool printTokens);
 
     // destructively read & return the next token, skipping over whitespace
-    unique_ptr<Token> Get();
+    Token Get();
 
-    // non-destructively get the next token, pushing it back to be read again
+    // non-destructively get the next token, pushing it back to be read again;
+    // the pointer stays valid until the next token is read
     const Token* Peek();
 
     // Get() the next token, and check that it's of the expected SYMBOL type
-    unique_ptr<Token> Read(SYMBOL expected);
+    Token Read(SYMBOL expected);
 
     // read the next token only if it matches the expected token type.
     // Return whether it matches.
@@ -57,25 +56,42 @@ class Tokenizer {
     // last phase to be executed
     void ScanProgram();
 
+    // Fast path for the long numeric arrays of trimeshes.  If the input
+    // continues with a parenthesized list of at most max plain numbers,
+    // such as "(1.5, -2, 3e-1)", read it straight from the text into
+    // values without making tokens and return how many there were.
+    // Otherwise return -1 having consumed nothing but whitespace and
+    // comments, so the caller can read the same input token by token; that
+    // also gives the usual error messages.  Never taken while a token is
+    // pushed back.
+    int ScanTuple(double* values, int max);
+
+    // Parse a number from [first, last) the way strtod would, without
+    // copying or allocating.  Returns the end of the number, or first if
+    // there is none.  Plain decimals of up to 19 digits with small
+    // exponents (nearly everything in a scene file) are converted exactly
+    // right here; anything else is handed to strtod.
+    static const char* ScanScalar(const char* first, const char* last, double& value);
+
 protected:
     // private methods:
 
     // push the argument token back onto the scanner's token stream;
     // it will be returned by the next Get/Peek/Read/CondRead call
-    Token* GetNext();
-    void UnGet(Token* t);
+    Token GetNext();
+    void UnGet(const Token& t);
 
-    Token* SearchReserved(const string&) const; // Convert ident string into token
+    Token SearchReserved(const string&) const; // Convert ident string into token
 
     void GetCh() { CurrentCh = buffer.GetCh(); }
     bool CondReadCh(char expected);        // consume a character, if it matches
 
     void SkipWhiteSpace();        // skip spaces, tabs, newlines
 
-    Token* GetPunct();            // scan punctuation token
-    Token* GetScalar();           // scan integer token
-    Token* GetIdent();            // scan identifier token
-    Token* GetQuotedIdent();
+    Token GetPunct();             // scan punctuation token
+    Token GetScalar();            // scan integer token
+    Token GetIdent();             // scan identifier token
+    Token GetQuotedIdent();
 
 
     // private data:
@@ -83,7 +99,8 @@ protected:
     Buffer buffer;                // The file buffer
     char CurrentCh;               // The current character in the current line
 
-    Token* UnGetToken;            // The token that has been "ungot"
+    Token UnGetToken;             // The token that has been "ungot"
+    bool HaveUnGetToken;          // ... if there is one
 
     int TokenColumn;              // The column where the last read token starts,
                                   // for generating error messages
@@ -4,39 +4,41 @@ class BoundingBox {
 	
 	bool bEmpty;
 	bool dirty;
-	glm::dvec3 bmin;
-	glm::dvec3 bmax;
-	double bArea;
-	double bVolume;
+	rvec3 bmin;
+	rvec3 bmax;
+	real bArea;
+	real bVolume;
 
 public:
 
-	BoundingBox() : bEmpty(true) {}
-	BoundingBox(glm::dvec3 bMin, glm::dvec3 bMax) : bmin(bMin), bmax(bMax), bEmpty(false), dirty(true) {}
+	BoundingBox() : bEmpty(true), dirty(true), bArea(0.0), bVolume(0.0) {}
+	BoundingBox(rvec3 bMin, rvec3 bMax) : bEmpty(false), dirty(true), bmin(bMin), bmax(bMax), bArea(0.0), bVolume(0.0) {}
 
-	glm::dvec3 getMin() const { return bmin; }
-	glm::dvec3 getMax() const { return bmax; }
+	rvec3 getMin() const { return bmin; }
+	rvec3 getMax() const { return bmax; }
 	bool isEmpty() { return bEmpty; }
 
-	void setMin(glm::dvec3 bMin) {
+	void setMin(rvec3 bMin) {
 		bmin = bMin;
 		dirty = true;
 		bEmpty = false;
 	}
-	void setMax(glm::dvec3 bMax) {
+	void setMax(rvec3 bMax) {
 		bmax = bMax;
 		dirty = true;
 		bEmpty = false;
 	}
-	void setMin(int i, double val) {
+	void setMin(int i, real val) {
 		if (i == 0) { bmin[0] = val; bEmpty = false; }
 		else if (i == 1) { bmin[1] = val; bEmpty = false; }
 			else if (i == 2) { bmin[2] = val; bEmpty = false; }
+		dirty = true;
 	}
-	void setMax(int i, double val) {
+	void setMax(int i, real val) {
 		if (i == 0) { bmax[0] = val; bEmpty = false; }
 		else if (i == 1) { bmax[1] = val; bEmpty = false; }
 			else if (i == 2) { bmax[2] = val; bEmpty = false; }
+		dirty = true;
 	}
 	void setEmpty() {
 		bEmpty = true;
@@ -50,7 +52,7 @@ public:
 	}
 
 	// does the box contain this point?
-	bool intersects(const glm::dvec3& point) const {
+	bool intersects(const rvec3& point) const {
 		return ((point[0] + RAY_EPSILON >= bmin[0]) && (point[1] + RAY_EPSILON >= bmin[1]) && (point[2] + RAY_EPSILON >= bmin[2]) &&
 			(point[0] - RAY_EPSILON <= bmax[0]) && (point[1] - RAY_EPSILON <= bmax[1]) && (point[2] - RAY_EPSILON <= bmax[2]));
 	}
@@ -59,22 +61,22 @@ public:
 	// closest to the origin in tMin and the "t" value of the far intersection
 	// in tMax and return true, else return false.
 	// Using Kay/Kajiya algorithm.
-	bool intersect(const ray& r, double& tMin, double& tMax) const {
-		glm::dvec3 R0 = r.getPosition();
-		glm::dvec3 Rd = r.getDirection();
-		tMin = -1.0e308; // 1.0e308 is close to infinity... close enough for us!
-		tMax = 1.0e308;
-		double ttemp;
+	bool intersect(const ray& r, real& tMin, real& tMax) const {
+		rvec3 R0 = r.getPosition();
+		rvec3 Rd = r.getDirection();
+		tMin = -REAL_MAX;
+		tMax = REAL_MAX;
+		real ttemp;
 	
 		for (int currentaxis = 0; currentaxis < 3; currentaxis++) {
-			double vd = Rd[currentaxis];
+			real vd = Rd[currentaxis];
 			// if the ray is parallel to the face's plane (=0.0)
 			if( vd == 0.0 ) continue;
-			double v1 = bmin[currentaxis] - R0[currentaxis];
-			double v2 = bmax[currentaxis] - R0[currentaxis];
+			real v1 = bmin[currentaxis] - R0[currentaxis];
+			real v2 = bmax[currentaxis] - R0[currentaxis];
 			// two slab intersections
-			double t1 = v1/vd;
-			double t2 = v2/vd;
+			real t1 = v1/vd;
+			real t2 = v2/vd;
 			if ( t1 > t2 ) { // swap t1 & t2
 				ttemp = t1;
 				t1 = t2;
@@ -97,7 +99,7 @@ public:
 		bEmpty = target.bEmpty;
 	}
 
-	double area() {
+	real area() {
 		if (bEmpty) return 0.0;
 		else if (dirty) {
 			bArea = 2.0 * ((bmax[0] - bmin[0]) * (bmax[1] - bmin[1]) + (bmax[1] - bmin[1]) * (bmax[2] - bmin[2]) + (bmax[2] - bmin[2]) * (bmax[0] - bmin[0]));
@@ -106,7 +108,7 @@ public:
 		return bArea;
 	}
 
-	double volume() {
+	real volume() {
 		if (bEmpty) return 0.0;
 		else if (dirty) {
 			bVolume = ((bmax[0] - bmin[0]) * (bmax[1] - bmin[1]) * (bmax[2] - bmin[2]));
@@ -0,0 +1,164 @@
+#include "bvh.h"
+
+#include <glm/glm.hpp>
+
+using namespace std;
+
+namespace {
+
+const int numBins = 16;
+const int maxDepth = 60;
+
+struct Bin {
+	BoundingBox bounds;
+	int count;
+	Bin() : count(0) {}
+};
+
+real halfArea(const rvec3& bmin, const rvec3& bmax)
+{
+	rvec3 e = bmax - bmin;
+	return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+}
+
+}
+
+void BVH::build(const vector<BoundingBox>& bounds, int leafSize)
+{
+	nodes.clear();
+	indices.resize(bounds.size());
+	if (bounds.empty()) return;
+
+	vector<rvec3> centroids(bounds.size());
+	for (size_t k = 0; k < bounds.size(); k++) {
+		indices[k] = (int)k;
+		centroids[k] = real(0.5) * (bounds[k].getMin() + bounds[k].getMax());
+	}
+
+	nodes.reserve(2 * bounds.size() / max(leafSize, 1) + 1);
+	buildRange(bounds, centroids, 0, (int)bounds.size(), max(leafSize, 1), 0);
+}
+
+bool BVH::valid(size_t primitives) const
+{
+	if (indices.size() != primitives) return false;
+	for (size_t k = 0; k < indices.size(); k++)
+		if (indices[k] < 0 || (size_t)indices[k] >= primitives) return false;
+
+	// Children come after their parent, so one pass in index order sees
+	// every node's depth before its children need it.
+	vector<int> depth(nodes.size(), 0);
+	for (size_t n = 0; n < nodes.size(); n++) {
+		const Node& node = nodes[n];
+		if (node.count > 0) {
+			if (node.offset < 0 || (size_t)node.offset + node.count > primitives) return false;
+			continue;
+		}
+		if (node.count < 0 || node.axis < 0 || node.axis > 2 ||
+			node.offset <= (int)n || (size_t)node.offset >= nodes.size() ||
+			depth[n] >= maxDepth)
+			return false;
+		depth[n + 1] = max(depth[n + 1], depth[n] + 1);
+		depth[node.offset] = max(depth[node.offset], depth[n] + 1);
+	}
+	return true;
+}
+
+// Build the subtree for indices[begin, end) and return its node index.
+// Splits are chosen with a binned surface area heuristic over the
+// primitive centroids.
+int BVH::buildRange(const vector<BoundingBox>& bounds, const vector<rvec3>& centroids,
+	int begin, int end, int leafSize, int depth)
+{
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+
+	BoundingBox box;
+	rvec3 cmin = centroids[indices[begin]];
+	rvec3 cmax = cmin;
+	for (int k = begin; k < end; k++) {
+		box.merge(bounds[indices[k]]);
+		cmin = glm::min(cmin, centroids[indices[k]]);
+		cmax = glm::max(cmax, centroids[indices[k]]);
+	}
+	nodes[index].bmin = box.getMin();
+	nodes[index].bmax = box.getMax();
+	nodes[index].axis = 0;
+
+	int count = end - begin;
+	rvec3 extent = cmax - cmin;
+	int axis = 0;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	if (count <= leafSize || depth >= maxDepth || extent[axis] <= 0.0) {
+		nodes[index].offset = begin;
+		nodes[index].count = count;
+		return index;
+	}
+
+	// Bin the centroids along the widest axis and sweep the bin boundaries
+	// for the cheapest split.
+	Bin bins[numBins];
+	real scale = numBins / extent[axis];
+	for (int k = begin; k < end; k++) {
+		int b = min(numBins - 1, (int)((centroids[indices[k]][axis] - cmin[axis]) * scale));
+		bins[b].count++;
+		bins[b].bounds.merge(bounds[indices[k]]);
+	}
+
+	real rightArea[numBins];
+	int rightCount[numBins];
+	BoundingBox acc;
+	int accCount = 0;
+	for (int b = numBins - 1; b > 0; b--) {
+		acc.merge(bins[b].bounds);
+		accCount += bins[b].count;
+		rightCount[b] = accCount;
+		rightArea[b] = accCount ? halfArea(acc.getMin(), acc.getMax()) : 0.0;
+	}
+
+	int bestSplit = -1;
+	real bestCost = (real)count;
+	acc.setEmpty();
+	accCount = 0;
+	real invArea = 1.0 / max(halfArea(box.getMin(), box.getMax()), numeric_limits<real>::min());
+	for (int b = 1; b < numBins; b++) {
+		acc.merge(bins[b - 1].bounds);
+		accCount += bins[b - 1].count;
+		if (accCount == 0 || rightCount[b] == 0) continue;
+		real cost = 0.125 + (accCount * halfArea(acc.getMin(), acc.getMax()) +
+			rightCount[b] * rightArea[b]) * invArea;
+		if (cost < bestCost) {
+			bestCost = cost;
+			bestSplit = b;
+		}
+	}
+
+	int mid;
+	if (bestSplit < 0) {
+		// The heuristic prefers a leaf; only honor it while the leaf is
+		// still reasonably small, otherwise fall back to a median split.
+		if (count <= 4 * leafSize) {
+			nodes[index].offset = begin;
+			nodes[index].count = count;
+			return index;
+		}
+		mid = begin + count / 2;
+		nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+			[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	} else {
+		int* split = partition(&indices[0] + begin, &indices[0] + end, [&](int k) {
+			int b = min(numBins - 1, (int)((centroids[k][axis] - cmin[axis]) * scale));
+			return b < bestSplit;
+		});
+		mid = (int)(split - &indices[0]);
+	}
+
+	nodes[index].axis = axis;
+	nodes[index].count = 0;
+	buildRange(bounds, centroids, begin, mid, leafSize, depth + 1);
+	int second = buildRange(bounds, centroids, mid, end, leafSize, depth + 1);
+	nodes[index].offset = second;
+	return index;
+}
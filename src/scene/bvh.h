@@ -0,0 +1,218 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "ray.h"
+#include "bbox.h"
+
+#include <glm/vec3.hpp>
+
+// A bounding volume hierarchy over an indexed set of primitives.  The BVH
+// itself knows nothing about the primitives: it is built from their bounds
+// and hands the caller ranges of primitive indices to test.  After build(),
+// order() gives the primitive index stored at each leaf slot, so a caller
+// that reorders its primitives by it can address leaves directly.
+class BVH {
+public:
+	// A node's children are stored next to each other: the first child
+	// immediately follows its parent and the second is at 'offset'.  A
+	// leaf (count > 0) covers leaf slots [offset, offset + count).
+	struct Node {
+		rvec3 bmin;
+		rvec3 bmax;
+		int offset;
+		int count;
+		int axis;
+	};
+
+	BVH() {}
+
+	// Build over the given primitive bounds, putting at most leafSize
+	// primitives in a leaf unless the surface area heuristic says a split
+	// does not pay off.
+	void build(const std::vector<BoundingBox>& bounds, int leafSize);
+
+	void clear() { nodes.clear(); indices.clear(); }
+	bool empty() const { return nodes.empty(); }
+	const std::vector<int>& order() const { return indices; }
+	const std::vector<Node>& getNodes() const { return nodes; }
+
+	// Take over a tree saved from getNodes() and order(), leaving the
+	// arguments empty.
+	void restore(std::vector<Node>& savedNodes, std::vector<int>& savedOrder)
+	{
+		nodes.swap(savedNodes);
+		indices.swap(savedOrder);
+		savedNodes.clear();
+		savedOrder.clear();
+	}
+
+	// Is this a tree the traversals can walk safely over 'primitives'
+	// primitives?  Checks what build() guarantees: children in range and
+	// after their parent, leaves within the leaf slots, depth within the
+	// traversal stacks and every order() entry a primitive index.
+	bool valid(size_t primitives) const;
+
+	// Walk the tree front to back along the ray p + t*d for t in (0, tmax].
+	// visit(first, count) is called for each leaf the ray reaches; it may
+	// lower tmax (which is re-read after every leaf) to cull farther nodes,
+	// and returns true to stop the traversal altogether.
+	template <typename Visit>
+	void traverse(const rvec3& p, const rvec3& d, real& tmax, Visit visit) const
+	{
+		if (nodes.empty()) return;
+
+		// a zero inverse marks an axis the ray is parallel to
+		rvec3 inv;
+		for (int k = 0; k < 3; k++)
+			inv[k] = d[k] != 0.0 ? 1.0 / d[k] : 0.0;
+
+		// build() caps the depth well below this
+		int stack[64];
+		real stackNear[64];
+		int top = 0;
+		int n = 0;
+		real tnear;
+		if (!hitNode(nodes[0], p, inv, tmax, tnear)) return;
+
+		for (;;) {
+			const Node& node = nodes[n];
+			if (node.count > 0) {
+				if (visit(node.offset, node.count)) return;
+			} else {
+				int a = n + 1;
+				int b = node.offset;
+				real ta, tb;
+				bool hitA = hitNode(nodes[a], p, inv, tmax, ta);
+				bool hitB = hitNode(nodes[b], p, inv, tmax, tb);
+				if (hitA && hitB) {
+					if (tb < ta) {
+						std::swap(a, b);
+						std::swap(ta, tb);
+					}
+					stack[top] = b;
+					stackNear[top] = tb;
+					top++;
+					n = a;
+					continue;
+				}
+				if (hitA) { n = a; continue; }
+				if (hitB) { n = b; continue; }
+			}
+			// skip subtrees that now start beyond the closest hit
+			do {
+				if (top == 0) return;
+				top--;
+			} while (stackNear[top] > tmax);
+			n = stack[top];
+		}
+	}
+
+	enum { MAX_PACKET = 16 };
+
+	// Walk the tree once for a packet of n <= MAX_PACKET rays that share
+	// the origin p, such as primary rays through neighbouring pixels.  A
+	// node is culled for the whole packet at once by interval arithmetic
+	// over the packet's inverse directions, and children are taken near
+	// side first along the split axis.  visit(first, count, mask) is called
+	// for each leaf the packet may reach, where bit k of mask is set if
+	// ray k hits the leaf's box within tmax[k]; it may lower the tmax[k]
+	// and returns true to stop.  Returns false, having visited nothing,
+	// if the directions are too spread for the interval test: some
+	// component is zero or changes sign across the packet.
+	template <typename Visit>
+	bool traversePacket(const rvec3& p, const rvec3* d, int n, real* tmax, Visit visit) const
+	{
+		rvec3 inv[MAX_PACKET];
+		rvec3 invLo, invHi;
+		for (int k = 0; k < 3; k++) {
+			for (int j = 0; j < n; j++) {
+				if (d[j][k] == 0.0 || (d[j][k] < 0.0) != (d[0][k] < 0.0)) return false;
+				inv[j][k] = 1.0 / d[j][k];
+			}
+			invLo[k] = invHi[k] = inv[0][k];
+			for (int j = 1; j < n; j++) {
+				invLo[k] = std::min(invLo[k], inv[j][k]);
+				invHi[k] = std::max(invHi[k], inv[j][k]);
+			}
+		}
+		if (nodes.empty()) return true;
+
+		int stack[64];
+		int top = 0;
+		int cur = 0;
+		for (;;) {
+			const Node& node = nodes[cur];
+			real tfar = tmax[0];
+			for (int j = 1; j < n; j++) tfar = std::max(tfar, tmax[j]);
+			if (hitPacket(node, p, invLo, invHi, tfar)) {
+				if (node.count > 0) {
+					unsigned mask = 0;
+					real tnear;
+					for (int j = 0; j < n; j++)
+						if (hitNode(node, p, inv[j], tmax[j], tnear)) mask |= 1u << j;
+					if (mask && visit(node.offset, node.count, mask)) return true;
+				} else {
+					// the first child holds the lower half along the axis
+					int a = cur + 1;
+					int b = node.offset;
+					if (invLo[node.axis] < 0.0) std::swap(a, b);
+					stack[top++] = b;
+					cur = a;
+					continue;
+				}
+			}
+			if (top == 0) return true;
+			cur = stack[--top];
+		}
+	}
+
+private:
+	// Could any ray from p with inverse direction in [invLo, invHi] (one
+	// sign per axis) hit the node for t in (0, tmax]?  Conservative: the
+	// interval bounds the earliest entry and the latest exit per axis.
+	static bool hitPacket(const Node& node, const rvec3& p, const rvec3& invLo,
+		const rvec3& invHi, real tmax)
+	{
+		real t0 = 0.0;
+		real t1 = tmax;
+		for (int k = 0; k < 3; k++) {
+			real lo = invLo[k] > 0.0 ? node.bmin[k] - p[k] : node.bmax[k] - p[k];
+			real hi = invLo[k] > 0.0 ? node.bmax[k] - p[k] : node.bmin[k] - p[k];
+			real tlo = std::min(lo * invLo[k], lo * invHi[k]);
+			real thi = std::max(hi * invLo[k], hi * invHi[k]);
+			if (tlo > t0) t0 = tlo;
+			if (thi < t1) t1 = thi;
+			if (t0 > t1) return false;
+		}
+		return true;
+	}
+
+	static bool hitNode(const Node& node, const rvec3& p, const rvec3& inv,
+		real tmax, real& tnear)
+	{
+		real t0 = 0.0;
+		real t1 = tmax;
+		for (int k = 0; k < 3; k++) {
+			if (inv[k] == 0.0) {
+				if (p[k] < node.bmin[k] || p[k] > node.bmax[k]) return false;
+				continue;
+			}
+			real tlo = (node.bmin[k] - p[k]) * inv[k];
+			real thi = (node.bmax[k] - p[k]) * inv[k];
+			if (tlo > thi) std::swap(tlo, thi);
+			if (tlo > t0) t0 = tlo;
+			if (thi < t1) t1 = thi;
+			if (t0 > t1) return false;
+		}
+		tnear = t0;
+		return true;
+	}
+
+	int buildRange(const std::vector<BoundingBox>& bounds,
+		const std::vector<rvec3>& centroids, int begin, int end, int leafSize, int depth);
+
+	std::vector<Node> nodes;
+	std::vector<int> indices;
+};
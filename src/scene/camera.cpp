@@ -11,32 +11,32 @@ Camera::Camera()
     aspectRatio = 1;
     normalizedHeight = 1;
     
-    eye = glm::dvec3(0,0,0);
-    u = glm::dvec3( 1,0,0 );
-    v = glm::dvec3( 0,1,0 );
-    look = glm::dvec3( 0,0,-1 );
+    eye = rvec3(0,0,0);
+    u = rvec3( 1,0,0 );
+    v = rvec3( 0,1,0 );
+    look = rvec3( 0,0,-1 );
 }
 
 void
-Camera::rayThrough(double x, double y, ray &r)
+Camera::rayThrough(real x, real y, ray &r)
 // Ray through normalized window point x,y.  In normalized coordinates
 // the camera's x and y vary both vary from 0 to 1.
 {
 	x -= 0.5;
 	y -= 0.5;
-	glm::dvec3 dir = glm::normalize(look + x * u + y * v);
+	rvec3 dir = glm::normalize(look + x * u + y * v);
 	r.p = eye;
 	r.d = dir;
 }
 
 void
-Camera::setEye(const glm::dvec3 &eye)
+Camera::setEye(const rvec3 &eye)
 {
     this->eye = eye;
 }
 
 void
-Camera::setLook(double r, double i, double j, double k)
+Camera::setLook(real r, real i, real j, real k)
 // Set the direction for the camera to look using a quaternion.  The
 // default camera looks down the neg z axis with the pos y axis as up.
 // We derive the new look direction by rotating the camera by the
@@ -61,20 +61,20 @@ Camera::setLook(double r, double i, double j, double k)
 }
 
 void
-Camera::setLook(const glm::dvec3 &viewDir, const glm::dvec3 &upDir)
+Camera::setLook(const rvec3 &viewDir, const rvec3 &upDir)
 {
-    glm::dvec3 z = -viewDir;          // this is where the z axis should end up
-    const glm::dvec3 &y = upDir;      // where the y axis should end up
-    glm::dvec3 x = glm::cross(y, z);             // lah,
+    rvec3 z = -viewDir;          // this is where the z axis should end up
+    const rvec3 &y = upDir;      // where the y axis should end up
+    rvec3 x = glm::cross(y, z);             // lah,
 
     //m = Mat3d( x[0],x[1],x[2],y[0],y[1],y[2],z[0],z[1],z[2] ).transpose();
-    m = glm::dmat3x3(x, y, z); // Do we need to transpose?
+    m = rmat3(x, y, z); // Do we need to transpose?
 
     update();
 }
 
 void
-Camera::setFOV(double fov)
+Camera::setFOV(real fov)
 // fov - field of view (height) in degrees    
 {
     fov /= (180.0 / PI);      // convert to radians
@@ -83,7 +83,7 @@ Camera::setFOV(double fov)
 }
 
 void
-Camera::setAspectRatio(double ar)
+Camera::setAspectRatio(real ar)
 // ar - ratio of width to height
 {
     aspectRatio = ar;
@@ -93,7 +93,7 @@ Camera::setAspectRatio(double ar)
 void
 Camera::update()
 {
-    u = m * glm::dvec3(1, 0, 0) * normalizedHeight*aspectRatio;
-    v = m * glm::dvec3(0, 1, 0) * normalizedHeight;
-    look = m * glm::dvec3(0, 0, -1);
+    u = m * rvec3(1, 0, 0) * normalizedHeight*aspectRatio;
+    v = m * rvec3(0, 1, 0) * normalizedHeight;
+    look = m * rvec3(0, 0, -1);
 }
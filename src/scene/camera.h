@@ -9,29 +9,31 @@ class Camera
 {
 public:
     Camera();
-    void rayThrough( double x, double y, ray &r );
-    void setEye( const glm::dvec3 &eye );
-    void setLook( double, double, double, double );
-    void setLook( const glm::dvec3 &viewDir, const glm::dvec3 &upDir );
-    void setFOV( double );
-    void setAspectRatio( double );
+    void rayThrough( real x, real y, ray &r );
+    void setEye( const rvec3 &eye );
+    void setLook( real, real, real, real );
+    void setLook( const rvec3 &viewDir, const rvec3 &upDir );
+    void setFOV( real );
+    void setAspectRatio( real );
 
-    double getAspectRatio() { return aspectRatio; }
+    real getAspectRatio() { return aspectRatio; }
 
-	const glm::dvec3& getEye() const			{ return eye; }
-	const glm::dvec3& getLook() const		{ return look; }
-	const glm::dvec3& getU() const			{ return u; }
-	const glm::dvec3& getV() const			{ return v; }
+	const rvec3& getEye() const			{ return eye; }
+	const rvec3& getLook() const		{ return look; }
+	const rvec3& getU() const			{ return u; }
+	const rvec3& getV() const			{ return v; }
 private:
-    glm::dmat3 m;                     // rotation matrix
-    double normalizedHeight;    // dimensions of image place at unit dist from eye
-    double aspectRatio;
+    friend class SceneCache;
+
+    rmat3 m;                     // rotation matrix
+    real normalizedHeight;    // dimensions of image place at unit dist from eye
+    real aspectRatio;
     
     void update();              // using the above three values calculate look,u,v
     
-    glm::dvec3 eye;
-    glm::dvec3 look;                  // direction to look
-    glm::dvec3 u,v;                   // u and v in the 
+    rvec3 eye;
+    rvec3 look;                  // direction to look
+    rvec3 u,v;                   // u and v in the 
 };
 
 #endif
@@ -37,7 +37,7 @@ public:
 		if (tMap[5] != m) tMap[5] = m;
 	}
 
-	glm::dvec3 getColor(ray r) const;
+	rvec3 getColor(ray r) const;
 
 	~CubeMap() {
 		for (int i = 0; i < 6; i++) if (tMap[i]) { delete tMap[i]; tMap[i] = 0; }
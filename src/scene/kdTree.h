@@ -1,3 +1,345 @@
 #pragma once
 
-// Note: you can put kd-tree here
+#include <vector>
+#include <algorithm>
+
+#include "ray.h"
+#include "bbox.h"
+
+// A kd-tree over any object type that provides getBoundingBox() and
+// intersect(const ray&, isect&), plus occluded(const ray&, real) for occlusion
+// queries, e.g. Geometry.  The tree is built once with
+// the surface area heuristic (SAH); objects that straddle a split plane
+// are referenced from both sides.  Only pointers to the objects are
+// stored, so the caller keeps ownership of them.
+template <typename Obj>
+class KdTree {
+
+	// A node is either an interior node (axis 0-2) whose "below" child
+	// immediately follows it and whose "above" child is at index 'above',
+	// or a leaf (axis 3) covering 'count' entries of 'leafObjects' starting
+	// at 'first'.
+	struct Node {
+		int axis;
+		real split;
+		int above;
+		int first;
+		int count;
+	};
+
+	struct Event {
+		real pos;
+		int type;		// 0 = object ends here, 1 = object starts here
+		bool operator<(const Event& e) const {
+			return pos < e.pos || (pos == e.pos && type < e.type);
+		}
+	};
+
+	struct StackEntry {
+		int node;
+		real tmin;
+		real tmax;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<const Obj*> leafObjects;
+	BoundingBox treeBounds;
+	int depthLimit;
+	int leafLimit;
+
+	// SAH constants: relative cost of a traversal step versus an object test,
+	// and the discount given to splits that cut off empty space.
+	static constexpr real traversalCost = 1.0;
+	static constexpr real intersectCost = 1.5;
+	static constexpr real emptyBonus = 0.2;
+
+public:
+	KdTree() : depthLimit(0), leafLimit(0) {}
+
+	// Build the tree over objs.  Splitting stops once a node holds
+	// leafSize objects or fewer, once maxDepth is reached, or when the
+	// SAH says a split would cost more than testing everything.
+	void build(const std::vector<Obj*>& objs, int maxDepth, int leafSize) {
+		nodes.clear();
+		leafObjects.clear();
+		treeBounds.setEmpty();
+		depthLimit = std::max(maxDepth, 0);
+		leafLimit = std::max(leafSize, 1);
+
+		std::vector<const Obj*> all(objs.begin(), objs.end());
+		for (size_t k = 0; k < all.size(); k++)
+			treeBounds.merge(all[k]->getBoundingBox());
+		if (all.empty()) return;
+		buildNode(all, treeBounds, 0);
+	}
+
+	bool empty() const { return nodes.empty(); }
+	int maxDepth() const { return depthLimit; }
+	int leafSize() const { return leafLimit; }
+	const BoundingBox& bounds() const { return treeBounds; }
+
+	// Find the nearest intersection along r, visiting leaves front to back
+	// and stopping at the first leaf whose extent contains the closest hit.
+	bool intersect(const ray& r, isect& i) const {
+		if (nodes.empty()) return false;
+
+		real tmin, tmax;
+		if (!treeBounds.intersect(r, tmin, tmax)) return false;
+		if (tmin < 0.0) tmin = 0.0;
+
+		rvec3 p = r.getPosition();
+		rvec3 d = r.getDirection();
+
+		// depth is capped at 63 in buildNode, so this never overflows
+		StackEntry stack[64];
+		int top = 0;
+		bool have_one = false;
+		int n = 0;
+
+		for (;;) {
+			const Node* node = &nodes[n];
+			while (node->axis != 3) {
+				int axis = node->axis;
+				bool belowFirst = p[axis] < node->split ||
+					(p[axis] == node->split && d[axis] <= 0.0);
+				int first = belowFirst ? n + 1 : node->above;
+				int second = belowFirst ? node->above : n + 1;
+
+				if (d[axis] == 0.0) {
+					// a ray lying in the split plane may hit objects on either side
+					if (p[axis] == node->split) {
+						stack[top].node = second;
+						stack[top].tmin = tmin;
+						stack[top].tmax = tmax;
+						top++;
+					}
+					n = first;
+				} else {
+					real tsplit = (node->split - p[axis]) / d[axis];
+					if (tsplit > tmax || tsplit <= 0.0) {
+						n = first;
+					} else if (tsplit < tmin) {
+						n = second;
+					} else {
+						stack[top].node = second;
+						stack[top].tmin = tsplit;
+						stack[top].tmax = tmax;
+						top++;
+						n = first;
+						tmax = tsplit;
+					}
+				}
+				node = &nodes[n];
+			}
+
+			for (int k = node->first; k < node->first + node->count; k++) {
+				isect cur;
+				if (leafObjects[k]->intersect(r, cur)) {
+					if (!have_one || cur.t < i.t) {
+						i = cur;
+						have_one = true;
+					}
+				}
+			}
+			// Pending entries are ordered with the nearest on top; one of them
+			// can only start before the hit if the ray runs in a split plane.
+			if (have_one && i.t <= tmax && (top == 0 || stack[top - 1].tmin >= i.t))
+				return true;
+			if (top == 0) return have_one;
+
+			top--;
+			n = stack[top].node;
+			tmin = stack[top].tmin;
+			tmax = stack[top].tmax;
+		}
+	}
+
+	// Is there any hit along r with t < tmax?  Leaves are visited in the
+	// same order as by intersect(), but the first hit found ends the walk;
+	// the object hit is stored in *blocker if it is given.
+	bool occluded(const ray& r, real tlimit, const Obj** blocker = 0) const {
+		if (nodes.empty()) return false;
+
+		real tmin, tmax;
+		if (!treeBounds.intersect(r, tmin, tmax)) return false;
+		if (tmin < 0.0) tmin = 0.0;
+		if (tmax > tlimit) tmax = tlimit;
+		if (tmin >= tmax) return false;
+
+		rvec3 p = r.getPosition();
+		rvec3 d = r.getDirection();
+
+		StackEntry stack[64];
+		int top = 0;
+		int n = 0;
+
+		for (;;) {
+			const Node* node = &nodes[n];
+			while (node->axis != 3) {
+				int axis = node->axis;
+				bool belowFirst = p[axis] < node->split ||
+					(p[axis] == node->split && d[axis] <= 0.0);
+				int first = belowFirst ? n + 1 : node->above;
+				int second = belowFirst ? node->above : n + 1;
+
+				if (d[axis] == 0.0) {
+					if (p[axis] == node->split) {
+						stack[top].node = second;
+						stack[top].tmin = tmin;
+						stack[top].tmax = tmax;
+						top++;
+					}
+					n = first;
+				} else {
+					real tsplit = (node->split - p[axis]) / d[axis];
+					if (tsplit > tmax || tsplit <= 0.0) {
+						n = first;
+					} else if (tsplit < tmin) {
+						n = second;
+					} else {
+						stack[top].node = second;
+						stack[top].tmin = tsplit;
+						stack[top].tmax = tmax;
+						top++;
+						n = first;
+						tmax = tsplit;
+					}
+				}
+				node = &nodes[n];
+			}
+
+			// objects can reach beyond the leaf, so test against the
+			// caller's limit rather than the leaf's extent
+			for (int k = node->first; k < node->first + node->count; k++)
+				if (leafObjects[k]->occluded(r, tlimit)) {
+					if (blocker) *blocker = leafObjects[k];
+					return true;
+				}
+			if (top == 0) return false;
+
+			top--;
+			n = stack[top].node;
+			tmin = stack[top].tmin;
+			tmax = stack[top].tmax;
+		}
+	}
+
+private:
+	void makeLeaf(const std::vector<const Obj*>& objs) {
+		Node leaf;
+		leaf.axis = 3;
+		leaf.split = 0.0;
+		leaf.above = 0;
+		leaf.first = (int)leafObjects.size();
+		leaf.count = (int)objs.size();
+		leafObjects.insert(leafObjects.end(), objs.begin(), objs.end());
+		nodes.push_back(leaf);
+	}
+
+	void buildNode(const std::vector<const Obj*>& objs, BoundingBox box, int depth) {
+		int count = (int)objs.size();
+		if (count <= leafLimit || depth >= depthLimit || depth >= 63) {
+			makeLeaf(objs);
+			return;
+		}
+
+		rvec3 bmin = box.getMin();
+		rvec3 bmax = box.getMax();
+		rvec3 extent = bmax - bmin;
+		if (box.area() <= 0.0) {
+			makeLeaf(objs);
+			return;
+		}
+		real invArea = 1.0 / box.area();
+
+		int bestAxis = -1;
+		real bestSplit = 0.0;
+		real bestCost = intersectCost * count;
+
+		std::vector<Event> events;
+		events.reserve(2 * count);
+		for (int axis = 0; axis < 3; axis++) {
+			if (extent[axis] <= 0.0) continue;
+
+			events.clear();
+			for (int k = 0; k < count; k++) {
+				const BoundingBox& b = objs[k]->getBoundingBox();
+				Event start = { std::max(b.getMin()[axis], bmin[axis]), 1 };
+				Event end = { std::min(b.getMax()[axis], bmax[axis]), 0 };
+				events.push_back(start);
+				events.push_back(end);
+			}
+			std::sort(events.begin(), events.end());
+
+			int other1 = (axis + 1) % 3;
+			int other2 = (axis + 2) % 3;
+			real capArea = extent[other1] * extent[other2];
+			real capPerimeter = extent[other1] + extent[other2];
+
+			int below = 0;
+			int above = count;
+			for (size_t e = 0; e < events.size(); ) {
+				real pos = events[e].pos;
+				int ending = 0, starting = 0;
+				while (e < events.size() && events[e].pos == pos) {
+					if (events[e].type == 0) ending++;
+					else starting++;
+					e++;
+				}
+				above -= ending;
+
+				if (pos > bmin[axis] && pos < bmax[axis]) {
+					real belowArea = 2.0 * (capArea + (pos - bmin[axis]) * capPerimeter);
+					real aboveArea = 2.0 * (capArea + (bmax[axis] - pos) * capPerimeter);
+					real bonus = (below == 0 || above == 0) ? emptyBonus : 0.0;
+					real cost = traversalCost + intersectCost * (1.0 - bonus) *
+						(belowArea * invArea * below + aboveArea * invArea * above);
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = pos;
+					}
+				}
+
+				below += starting;
+			}
+		}
+
+		if (bestAxis < 0) {
+			makeLeaf(objs);
+			return;
+		}
+
+		std::vector<const Obj*> belowObjs, aboveObjs;
+		for (int k = 0; k < count; k++) {
+			const BoundingBox& b = objs[k]->getBoundingBox();
+			if (b.getMin()[bestAxis] < bestSplit) belowObjs.push_back(objs[k]);
+			if (b.getMax()[bestAxis] > bestSplit) aboveObjs.push_back(objs[k]);
+			// flat objects lying exactly in the split plane go below
+			if (b.getMin()[bestAxis] == bestSplit && b.getMax()[bestAxis] == bestSplit)
+				belowObjs.push_back(objs[k]);
+		}
+
+		BoundingBox belowBox = box;
+		BoundingBox aboveBox = box;
+		belowBox.setMax(bestAxis, bestSplit);
+		aboveBox.setMin(bestAxis, bestSplit);
+
+		int index = (int)nodes.size();
+		Node interior;
+		interior.axis = bestAxis;
+		interior.split = bestSplit;
+		interior.above = 0;
+		interior.first = 0;
+		interior.count = 0;
+		nodes.push_back(interior);
+
+		buildNode(belowObjs, belowBox, depth + 1);
+		nodes[index].above = (int)nodes.size();
+		buildNode(aboveObjs, aboveBox, depth + 1);
+	}
+};
+
+template <typename Obj> constexpr real KdTree<Obj>::traversalCost;
+template <typename Obj> constexpr real KdTree<Obj>::intersectCost;
+template <typename Obj> constexpr real KdTree<Obj>::emptyBonus;
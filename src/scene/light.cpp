@@ -1,4 +1,9 @@
 #include <cmath>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 #include "light.h"
 #include <glm/glm.hpp>
@@ -6,35 +11,117 @@
 
 using namespace std;
 
-double DirectionalLight::distanceAttenuation(const glm::dvec3& P) const
+namespace {
+
+struct OccluderCache;
+
+std::mutex cacheListLock;
+std::vector<OccluderCache*> cacheList;
+long retiredHits = 0;
+long retiredMisses = 0;
+long retiredUnblocked = 0;
+
+// One per thread.  The counters are only written by the owning thread,
+// so they need no read-modify-write; they are atomic so that stats can be
+// read from another thread.
+struct OccluderCache {
+	unsigned sceneSerial;
+	std::vector<const Geometry*> last;	// by light index
+	std::atomic<long> hits;
+	std::atomic<long> misses;
+	std::atomic<long> unblocked;
+
+	OccluderCache() : sceneSerial(0), hits(0), misses(0), unblocked(0) {
+		std::lock_guard<std::mutex> guard(cacheListLock);
+		cacheList.push_back(this);
+	}
+	~OccluderCache() {
+		std::lock_guard<std::mutex> guard(cacheListLock);
+		retiredHits += hits;
+		retiredMisses += misses;
+		retiredUnblocked += unblocked;
+		cacheList.erase(std::find(cacheList.begin(), cacheList.end(), this));
+	}
+	void count(std::atomic<long>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+};
+
+thread_local OccluderCache occluderCache;
+
+}
+
+bool Light::occluded(const ray& r, real tmax) const
+{
+	OccluderCache& cache = occluderCache;
+	if (cache.sceneSerial != scene->getSerial()) {
+		cache.sceneSerial = scene->getSerial();
+		cache.last.clear();
+	}
+	if (cache.last.size() <= (size_t)index)
+		cache.last.resize(index + 1, 0);
+
+	const Geometry*& last = cache.last[index];
+	if (last && last->occluded(r, tmax)) {
+		cache.count(cache.hits);
+		return true;
+	}
+	const Geometry* blocker = 0;
+	if (!scene->occluded(r, tmax, &blocker)) {
+		cache.count(cache.unblocked);
+		return false;
+	}
+	cache.count(cache.misses);
+	last = blocker;
+	return true;
+}
+
+ShadowCacheStats getShadowCacheStats()
+{
+	std::lock_guard<std::mutex> guard(cacheListLock);
+	ShadowCacheStats stats = { retiredHits, retiredMisses, retiredUnblocked };
+	for (size_t k = 0; k < cacheList.size(); k++) {
+		stats.hits += cacheList[k]->hits;
+		stats.misses += cacheList[k]->misses;
+		stats.unblocked += cacheList[k]->unblocked;
+	}
+	return stats;
+}
+
+void resetShadowCacheStats()
+{
+	std::lock_guard<std::mutex> guard(cacheListLock);
+	retiredHits = retiredMisses = retiredUnblocked = 0;
+	for (size_t k = 0; k < cacheList.size(); k++)
+		cacheList[k]->hits = cacheList[k]->misses = cacheList[k]->unblocked = 0;
+}
+
+real DirectionalLight::distanceAttenuation(const rvec3& P) const
 {
 	// distance to light is infinite, so f(di) goes to 0.  Return 1.
 	return 1.0;
 }
 
 
-glm::dvec3 DirectionalLight::shadowAttenuation(const ray& r, const glm::dvec3& p) const
+rvec3 DirectionalLight::shadowAttenuation(const ray& r, const rvec3& p) const
 {
-    ray lr = r;
-    isect i;
-    if(scene->intersect(lr, i)) {
-        return glm::dvec3(0.0, 0.0, 0.0);
-    }
+    if(occluded(r, std::numeric_limits<real>::infinity()))
+        return rvec3(0.0, 0.0, 0.0);
 
-    return glm::dvec3(1.0, 1.0, 1.0);
+    return rvec3(1.0, 1.0, 1.0);
 }
 
-glm::dvec3 DirectionalLight::getColor() const
+rvec3 DirectionalLight::getColor() const
 {
 	return color;
 }
 
-glm::dvec3 DirectionalLight::getDirection(const glm::dvec3& P) const
+rvec3 DirectionalLight::getDirection(const rvec3& P) const
 {
 	return -orientation;
 }
 
-double PointLight::distanceAttenuation(const glm::dvec3& P) const
+real PointLight::distanceAttenuation(const rvec3& P) const
 {
 
 	// YOUR CODE HERE
@@ -45,24 +132,22 @@ double PointLight::distanceAttenuation(const glm::dvec3& P) const
 	return 1.0;
 }
 
-glm::dvec3 PointLight::getColor() const
+rvec3 PointLight::getColor() const
 {
 	return color;
 }
 
-glm::dvec3 PointLight::getDirection(const glm::dvec3& P) const
+rvec3 PointLight::getDirection(const rvec3& P) const
 {
 	return glm::normalize(position - P);
 }
 
 
-glm::dvec3 PointLight::shadowAttenuation(const ray& r, const glm::dvec3& p) const
+rvec3 PointLight::shadowAttenuation(const ray& r, const rvec3& p) const
 {
-    ray lr = r;
-    isect i;
-    if(scene->intersect(lr, i) && i.t < glm::length(this->position - p))
-        return glm::dvec3(0.0, 0.0, 0.0);
+    if(occluded(r, glm::length(this->position - p)))
+        return rvec3(0.0, 0.0, 0.0);
 
-    return glm::dvec3(1.0, 1.0, 1.0);
+    return rvec3(1.0, 1.0, 1.0);
 }
 
@@ -15,16 +15,27 @@ class Light
 	: public SceneElement
 {
 public:
-	virtual glm::dvec3 shadowAttenuation(const ray& r, const glm::dvec3& pos) const = 0;
-	virtual double distanceAttenuation(const glm::dvec3& P) const = 0;
-	virtual glm::dvec3 getColor() const = 0;
-	virtual glm::dvec3 getDirection (const glm::dvec3& P) const = 0;
+	virtual rvec3 shadowAttenuation(const ray& r, const rvec3& pos) const = 0;
+	virtual real distanceAttenuation(const rvec3& P) const = 0;
+	virtual rvec3 getColor() const = 0;
+	virtual rvec3 getDirection (const rvec3& P) const = 0;
 
 
+	// Position of the light in its scene's light list, set by Scene::add().
+	void setIndex(int i) { index = i; }
+	int getIndex() const { return index; }
+
 protected:
-	Light(Scene *scene, const glm::dvec3& col) : SceneElement(scene), color(col) {}
+	Light(Scene *scene, const rvec3& col) : SceneElement(scene), color(col), index(0) {}
+
+	// Is the shadow ray r blocked before tmax?  Each thread remembers the
+	// object that last blocked its shadow rays to this light and tries it
+	// before walking the scene, since neighbouring pixels are usually
+	// shadowed by the same object.
+	bool occluded(const ray& r, real tmax) const;
 
-	glm::dvec3 color;
+	rvec3 color;
+	int index;
 
 public:
 	virtual void glDraw(GLenum lightID) const { }
@@ -35,15 +46,17 @@ class DirectionalLight
 	: public Light
 {
 public:
-	DirectionalLight(Scene *scene, const glm::dvec3& orien, const glm::dvec3& color)
+	DirectionalLight(Scene *scene, const rvec3& orien, const rvec3& color)
 		: Light(scene, color), orientation(glm::normalize(orien)) { }
-	virtual glm::dvec3 shadowAttenuation(const ray& r, const glm::dvec3& pos) const;
-	virtual double distanceAttenuation(const glm::dvec3& P) const;
-	virtual glm::dvec3 getColor() const;
-	virtual glm::dvec3 getDirection(const glm::dvec3& P) const;
+	virtual rvec3 shadowAttenuation(const ray& r, const rvec3& pos) const;
+	virtual real distanceAttenuation(const rvec3& P) const;
+	virtual rvec3 getColor() const;
+	virtual rvec3 getDirection(const rvec3& P) const;
 
 protected:
-	glm::dvec3 		orientation;
+	friend class SceneCache;
+
+	rvec3 		orientation;
 
 public:
 	void glDraw(GLenum lightID) const;
@@ -54,7 +67,7 @@ class PointLight
 	: public Light
 {
 public:
-	PointLight( Scene *scene, const glm::dvec3& pos, const glm::dvec3& color,
+	PointLight( Scene *scene, const rvec3& pos, const rvec3& color,
 		float constantAttenuationTerm, float linearAttenuationTerm,
 		float quadraticAttenuationTerm )
 		: Light( scene, color ), position( pos ),
@@ -63,10 +76,10 @@ public:
 		quadraticTerm(quadraticAttenuationTerm) 
 		{}
 
-	virtual glm::dvec3 shadowAttenuation(const ray& r, const glm::dvec3& pos) const;
-	virtual double distanceAttenuation(const glm::dvec3& P) const;
-	virtual glm::dvec3 getColor() const;
-	virtual glm::dvec3 getDirection(const glm::dvec3& P) const;
+	virtual rvec3 shadowAttenuation(const ray& r, const rvec3& pos) const;
+	virtual real distanceAttenuation(const rvec3& P) const;
+	virtual rvec3 getColor() const;
+	virtual rvec3 getDirection(const rvec3& P) const;
 
 	void setAttenuationConstants(float a, float b, float c)
 	{
@@ -76,7 +89,9 @@ public:
 	}
 
 protected:
-	glm::dvec3 position;
+	friend class SceneCache;
+
+	rvec3 position;
 
 	// These three values are the a, b, and c in the distance
 	// attenuation function (from the slide labelled 
@@ -94,4 +109,16 @@ protected:
 
 };
 
+// Shadow rays answered by the last-occluder caches (hits), blocked by some
+// other object (misses) and not blocked at all (unblocked, which the cache
+// cannot help with), summed over all threads.  The UIs reset them when a
+// render starts, so they cover that render alone.
+struct ShadowCacheStats {
+	long hits;
+	long misses;
+	long unblocked;
+};
+ShadowCacheStats getShadowCacheStats();
+void resetShadowCacheStats();
+
 #endif // __LIGHT_H__
@@ -7,6 +7,12 @@ extern TraceUI* traceUI;
 
 #include "../fileio/bitmap.h"
 #include "../fileio/pngimage.h"
+#include "../ThreadPool.h"
+
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 using namespace std;
 extern bool debugMode;
@@ -17,10 +23,10 @@ Material::~Material()
 
 // Apply the phong model to this point on the surface of the object, returning
 // the color of that point.
-glm::dvec3 Material::shade(Scene *scene, const ray& r, const isect& i) const
+rvec3 Material::shade(Scene *scene, const ray& r, const isect& i) const
 {
-	glm::dvec3 point = r.getPosition() + r.getDirection()*i.t;
-	glm::dvec3 totalI = ke(i) + ka(i)*scene->ambient();
+	rvec3 point = r.getPosition() + r.getDirection()*i.t;
+	rvec3 totalI = ke(i) + ka(i)*scene->ambient();
 
 	for ( vector<Light*>::const_iterator it = scene->beginLights();
 		  it != scene->endLights();
@@ -28,62 +34,148 @@ glm::dvec3 Material::shade(Scene *scene, const ray& r, const isect& i) const
 	{
 		// Iteration two: Diffuse reflection
 		Light* light = *it;
-		glm::dvec3 lightDir = light->getDirection(point);
-		double nDotL = glm::dot(i.N, lightDir);
+		rvec3 lightDir = light->getDirection(point);
+		real nDotL = glm::dot(i.N, lightDir);
 
 		// Special case when light is being hit from behind.
 		if(nDotL < 0) continue;
 
 
 
-        glm::dvec3 ref = glm::normalize(2.0*glm::dot(i.N, lightDir)*i.N - lightDir);
-        //glm::dvec3 v = glm::normalize(scene->getCamera().getEye() - point);
-        glm::dvec3 v = -glm::normalize(r.d);
+        rvec3 ref = glm::normalize(real(2.0)*glm::dot(i.N, lightDir)*i.N - lightDir);
+        //rvec3 v = glm::normalize(scene->getCamera().getEye() - point);
+        rvec3 v = -glm::normalize(r.d);
         ray toLightRay(point, lightDir, r.getPixel(), r.ctr, r.getAtten(), ray::SHADOW);
-        glm::dvec3 attenuation = light->distanceAttenuation(point)*light->shadowAttenuation(toLightRay, point);
+        rvec3 attenuation = light->distanceAttenuation(point)*light->shadowAttenuation(toLightRay, point);
 
-		glm::dvec3 Il = light->getColor();
-		double lightCos = max(0.0, nDotL);
+		rvec3 Il = light->getColor();
+		real lightCos = max(real(0.0), nDotL);
 
 		if(debugMode)
 			std::cout << "Light cos: " << lightCos << std::endl;
 
 		totalI += kd(i)*Il*lightCos*attenuation;
 
-		totalI += ks(i)*Il*max(0.0, pow(glm::dot(ref, v), shininess(i)))*attenuation;
+		totalI += ks(i)*Il*max(real(0.0), (real)pow(glm::dot(ref, v), shininess(i)))*attenuation;
 	}
 
 	return totalI;
 }
 
-TextureMap::TextureMap( string filename ) {
+// The pixels of a TextureMap.  A PNG read on a pool starts out PENDING with
+// its header read into png; whichever thread calls finish() first decodes
+// it while any others wait.
+struct TextureMap::Pixels {
+	enum State { PENDING, RUNNING, DONE };
+
+	std::mutex lock;
+	std::condition_variable finished;
+	State state;
+	std::atomic<bool> ready;	// state == DONE, checked without the lock
+
+	string filename;
+	PngReader png;
+	int height;
+	unsigned char* data;		// bottom row first; null if the load failed
+	bool deferred;			// decoded on a pool, after the constructor returned
+
+	Pixels( const string& name, int h )
+		: state( PENDING ), ready( false ), filename( name ), height( h ), data( 0 ),
+		  deferred( false ) {}
+	~Pixels() { png_cleanup( png, 1 ); delete[] data; }
+
+	const unsigned char* get()
+	{
+		if( !ready.load( std::memory_order_acquire ) ) finish( true );
+		return data;
+	}
+
+	// Decode the PNG, or wait for the thread that is decoding it.  With
+	// decode false a decode nobody has started is dropped instead.
+	void finish( bool decode );
+	void decodePng();
+};
+
+void TextureMap::Pixels::finish( bool decode )
+{
+	std::unique_lock<std::mutex> guard( lock );
+	if( state != PENDING ) {
+		finished.wait( guard, [this] { return state == DONE; } );
+		return;
+	}
+	state = RUNNING;
+	guard.unlock();
+
+	if( decode ) decodePng();
+	png_cleanup( png, 1 );
+
+	guard.lock();
+	state = DONE;
+	ready.store( true, std::memory_order_release );
+	finished.notify_all();
+}
 
+void TextureMap::Pixels::decodePng()
+{
+	double gamma = 2.2;
+	int channels, rowBytes;
+	unsigned char* indata = png_get_image( png, gamma, channels, rowBytes );
+	if( !indata ) {
+		// Too late to throw once the constructor has returned; lookups
+		// see white instead.  A synchronous load throws in the constructor.
+		if( deferred )
+			cerr << "Unable to decode texture map '" << filename << "'." << endl;
+		return;
+	}
+	unsigned char* flipped = new unsigned char[rowBytes * height];
+	for( int j = 0; j < height; j++ )
+		memcpy( flipped + j * rowBytes, indata + (height - j - 1) * rowBytes, rowBytes );
+	data = flipped;
+}
+
+TextureMap::TextureMap( string filename, ThreadPool* pool )
+	: filename( filename ), width( 0 ), height( 0 )
+{
 	int start = (int) filename.find_last_of('.');
 	int end = (int) filename.size() - 1;
+	bool loaded = false;
 	if (start >= 0 && start < end) {
 		string ext = filename.substr(start, end);
 		if (!ext.compare(".png")) {
-			png_cleanup(1);
-			if (!png_init(filename.c_str(), width, height)) {
-				double gamma = 2.2;
-				int channels, rowBytes;
-				unsigned char* indata = png_get_image(gamma, channels, rowBytes);
-				int bufsize = rowBytes * height;
-				data = new unsigned char[bufsize];
-				for (int j = 0; j < height; j++)
-					for (int i = 0; i < rowBytes; i += channels)
-						for (int k = 0; k < channels; k++)
-							*(data + k + i + j * rowBytes) = *(indata + k + i + (height - j - 1) * rowBytes);
-				png_cleanup(1);
+			int w, h;
+			PngReader png;
+			if (!png_init(png, filename.c_str(), w, h)) {
+				width = w;
+				height = h;
+				pixels.reset(new Pixels(filename, h));
+				pixels->png = png;
+				if (pool) {
+					pixels->deferred = true;
+					std::shared_ptr<Pixels> job(pixels);
+					pool->submit([job] { job->finish(true); });
+					loaded = true;
+				} else {
+					pixels->finish(true);
+					loaded = pixels->data != 0;
+				}
+			} else {
+				png_cleanup(png, 1);
 			}
 		}
-		else
-			if (!ext.compare(".bmp")) data = readBMP(filename.c_str(), width, height);
-			else data = NULL;
-	} else data = NULL;
-	if (data == NULL) {
-		width = 0;
-		height = 0;
+		else if (!ext.compare(".bmp")) {
+			int w, h;
+			unsigned char* data = readBMP(filename.c_str(), w, h);
+			if (data) {
+				width = w;
+				height = h;
+				pixels.reset(new Pixels(filename, h));
+				pixels->data = data;
+				pixels->finish(false);
+				loaded = true;
+			}
+		}
+	}
+	if (!loaded) {
 		string error("Unable to load texture map '");
 		error.append(filename);
 		error.append("'.");
@@ -91,30 +183,28 @@ TextureMap::TextureMap( string filename ) {
 	}
 }
 
-glm::dvec3 TextureMap::getMappedValue( const glm::dvec2& coord ) const
+TextureMap::~TextureMap()
 {
-    double x = coord.x * (double)getWidth();
-    double y = coord.y * (double)getHeight();
-
-    int xFloor = (int)x, xCeil = xFloor + 1, yFloor = (int)y, yCeil = yFloor + 1;
-
-	double xLeftDist = x - xFloor, xRightDist = xCeil - x, yBottomDist = y - yFloor, yTopDist = yCeil - y;
-
-    glm::dvec3 xTopInterpolation = xLeftDist*getPixelAt(xFloor, yCeil) + xRightDist*getPixelAt(xCeil, xCeil);
-    glm::dvec3 xBottomInterpolation = xLeftDist*getPixelAt(xFloor, yFloor) + xRightDist*getPixelAt(xCeil, xFloor);
+	// a queued decode still holds the pixels; make it a no-op
+	pixels->finish(false);
+}
 
-    glm::dvec3 totalInterpolation = yTopDist*xTopInterpolation + yBottomDist*xBottomInterpolation;
+rvec3 TextureMap::getMappedValue( const rvec2& coord ) const
+{
+    real x = coord.x * (real)getWidth();
+    real y = coord.y * (real)getHeight();
 
-	return getPixelAt(xFloor, yFloor);
+	return getPixelAt((int)x, (int)y);
 }
 
 
-glm::dvec3 TextureMap::getPixelAt( int x, int y ) const
+rvec3 TextureMap::getPixelAt( int x, int y ) const
 {
     // This keeps it from crashing if it can't load
     // the texture, but the person tries to render anyway.
+    const unsigned char* data = pixels->get();
     if (0 == data)
-      return glm::dvec3(1.0, 1.0, 1.0);
+      return rvec3(1.0, 1.0, 1.0);
 
     if( x >= width )
        x = width - 1;
@@ -123,12 +213,12 @@ glm::dvec3 TextureMap::getPixelAt( int x, int y ) const
 
     // Find the position in the big data array...
     int pos = (y * width + x) * 3;
-    return glm::dvec3(double(data[pos]) / 255.0, 
-       double(data[pos+1]) / 255.0,
-       double(data[pos+2]) / 255.0);
+    return rvec3(real(data[pos]) / 255.0, 
+       real(data[pos+1]) / 255.0,
+       real(data[pos+2]) / 255.0);
 }
 
-glm::dvec3 MaterialParameter::value( const isect& is ) const
+rvec3 MaterialParameter::value( const isect& is ) const
 {
     if( 0 != _textureMap )
         return _textureMap->getMappedValue( is.uvCoordinates );
@@ -136,11 +226,11 @@ glm::dvec3 MaterialParameter::value( const isect& is ) const
         return _value;
 }
 
-double MaterialParameter::intensityValue( const isect& is ) const
+real MaterialParameter::intensityValue( const isect& is ) const
 {
     if( 0 != _textureMap )
     {
-        glm::dvec3 value( _textureMap->getMappedValue( is.uvCoordinates ) );
+        rvec3 value( _textureMap->getMappedValue( is.uvCoordinates ) );
         return (0.299 * value[0]) + (0.587 * value[1]) + (0.114 * value[2]);
     }
     else
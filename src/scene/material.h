@@ -11,10 +11,15 @@
 #include <glm/vec3.hpp>
 #include <glm/glm.hpp>
 #include <string>
+#include <memory>
+
+#include "real.h"
 
 class Scene;
 class ray;
 class isect;
+class SceneCache;
+class ThreadPool;
 
 using std::string;
 
@@ -23,33 +28,53 @@ using std::string;
    it.  To implement basic texture mapping, you'll want to 
    fill in the getMappedValue function to implement basic 
    texture mapping.
+
+   Without a pool the image is read in the constructor.  With one, only
+   a PNG's header is read there (so a missing or broken file still throws
+   at once) and the pixels are decoded on the pool; the first lookup that
+   needs them waits for that decode, or does it itself if no worker has
+   started it yet.
 */
 class TextureMap {
     public:
-       TextureMap( string filename );
+       // Load a PNG or BMP file, throwing TextureMapException if it cannot
+       // be read.  With a pool, only a PNG's header is read here and its
+       // pixels are decoded on the pool, or by the first lookup if that
+       // comes sooner.  A decode that fails then can no longer throw: it
+       // prints an error to cerr and the map reads as white everywhere.
+       TextureMap( string filename, ThreadPool* pool = 0 );
 
        // Return the mapped value; here the coordinate
        // is assumed to be within the parametrization space:
        // [0, 1] x [0, 1]
        // (i.e., {(u, v): 0 <= u <= 1 and 0 <= v <= 1}
-       glm::dvec3 getMappedValue( const glm::dvec2& coord ) const;
+       rvec3 getMappedValue( const rvec2& coord ) const;
 
        // Retrieve the value stored in a physical location
        // (with integer coordinates) in the bitmap.
        // Should be called from getMappedValue in order to
        // do bilinear interpolation.
-       glm::dvec3 getPixelAt( int x, int y ) const;
+       rvec3 getPixelAt( int x, int y ) const;
 
+	   const string& getFilename() const { return filename; }
 	   int getWidth() const { return width; }
 	   int getHeight() const { return height; }
 
-	  ~TextureMap() { if (data) delete[] data; }
+	  ~TextureMap();
 
 protected:
        string filename;
        int width;
        int height;
-       unsigned char* data;
+
+private:
+       // The pixels, three bytes each, and the work of producing them.
+       // Shared with the pool job, which may outlive the map.
+       struct Pixels;
+       std::shared_ptr<Pixels> pixels;
+
+       TextureMap( const TextureMap& ) = delete;
+       TextureMap& operator=( const TextureMap& ) = delete;
 };
 
 class TextureMapException {
@@ -78,11 +103,11 @@ Material class is used often enough, that it is
 class MaterialParameter
 {
 public:
-    explicit MaterialParameter( const glm::dvec3& par )
+    explicit MaterialParameter( const rvec3& par )
       : _value( par ), _textureMap( 0 )
     { }
 
-    explicit MaterialParameter( const double par )
+    explicit MaterialParameter( const real par )
       : _value( par, par, par ), _textureMap( 0 )
     { }
 
@@ -100,7 +125,7 @@ public:
       return *this;
     }
 
-    glm::dvec3& operator*=( const glm::dvec3& rhs )
+    rvec3& operator*=( const rvec3& rhs )
     {
       _value[0] *= rhs[0];
       _value[1] *= rhs[1];
@@ -108,7 +133,7 @@ public:
       return _value;
     }
 
-    glm::dvec3& operator*=( const double rhs )
+    rvec3& operator*=( const real rhs )
     {
       _value[0] *= rhs;
       _value[1] *= rhs;
@@ -122,13 +147,13 @@ public:
       return *this;
     }
 
-    void setValue( const glm::dvec3& rhs )
+    void setValue( const rvec3& rhs )
     {
       _value = rhs;
       _textureMap = 0;
     }
 
-    void setValue( const double rhs )
+    void setValue( const real rhs )
     {
       _value[0] = rhs;
       _value[1] = rhs;
@@ -138,21 +163,23 @@ public:
 
 	bool isZero() { return glm::length(_value) == 0.0; }
 
-    glm::dvec3& operator+=( const glm::dvec3& rhs )
+    rvec3& operator+=( const rvec3& rhs )
     {
       _value += rhs;
       return _value;
     }
 
-    glm::dvec3 value( const isect& is ) const;
-    double intensityValue( const isect& is ) const;
+    rvec3 value( const isect& is ) const;
+    real intensityValue( const isect& is ) const;
 
 	// Use this to determine if the particular parameter is
 	// mapped; use this to determine if we need to somehow renormalize.
 	bool mapped() const { return _textureMap != 0; }
 
 private:
-    glm::dvec3 _value;
+    friend class SceneCache;
+
+    rvec3 _value;
     TextureMap* _textureMap;
 };
 
@@ -161,12 +188,12 @@ class Material
 
 public:
     Material()
-        : _ke( glm::dvec3( 0.0, 0.0, 0.0 ) )
-        , _ka( glm::dvec3( 0.0, 0.0, 0.0 ) )
-        , _ks( glm::dvec3( 0.0, 0.0, 0.0 ) )
-        , _kd( glm::dvec3( 0.0, 0.0, 0.0 ) )
-        , _kr( glm::dvec3( 0.0, 0.0, 0.0 ) )
-        , _kt( glm::dvec3( 0.0, 0.0, 0.0 ) )
+        : _ke( rvec3( 0.0, 0.0, 0.0 ) )
+        , _ka( rvec3( 0.0, 0.0, 0.0 ) )
+        , _ks( rvec3( 0.0, 0.0, 0.0 ) )
+        , _kd( rvec3( 0.0, 0.0, 0.0 ) )
+        , _kr( rvec3( 0.0, 0.0, 0.0 ) )
+        , _kt( rvec3( 0.0, 0.0, 0.0 ) )
 		, _refl(0)
 		, _trans(0)
         , _shininess( 0.0 ) 
@@ -174,12 +201,12 @@ public:
 
     virtual ~Material();
 
-    Material( const glm::dvec3& e, const glm::dvec3& a, const glm::dvec3& s, 
-              const glm::dvec3& d, const glm::dvec3& r, const glm::dvec3& t, double sh, double in )
+    Material( const rvec3& e, const rvec3& a, const rvec3& s, 
+              const rvec3& d, const rvec3& r, const rvec3& t, real sh, real in )
         : _ke( e ), _ka( a ), _ks( s ), _kd( d ), _kr( r ), _kt( t ), 
-          _shininess( glm::dvec3(sh,sh,sh) ), _index( glm::dvec3(in,in,in) ) { setBools(); }
+          _shininess( rvec3(sh,sh,sh) ), _index( rvec3(in,in,in) ) { setBools(); }
 
-    virtual glm::dvec3 shade( Scene *scene, const ray& r, const isect& i ) const;
+    virtual rvec3 shade( Scene *scene, const ray& r, const isect& i ) const;
 
 
     
@@ -194,22 +221,23 @@ public:
         _kt += m._kt;
         _index += m._index;
         _shininess += m._shininess;
+        setBools();
         return *this;
     }
 
-    friend Material operator*( double d, Material m );
+    friend Material operator*( real d, Material m );
 
     // Accessor functions; we pass in an isect& for cases where
     // the parameter is dependent on, for example, world-space
     // coordinates (i.e., solid textures) or parametrized coordinates
     // (i.e., mapped textures)
-    glm::dvec3 ke( const isect& i ) const { return _ke.value(i); }
-    glm::dvec3 ka( const isect& i ) const { return _ka.value(i); }
-    glm::dvec3 ks( const isect& i ) const { return _ks.value(i); }
-    glm::dvec3 kd( const isect& i ) const { return _kd.value(i); }
-    glm::dvec3 kr( const isect& i ) const { return _kr.value(i); }
-    glm::dvec3 kt( const isect& i ) const { return _kt.value(i); }
-    double shininess( const isect& i ) const
+    rvec3 ke( const isect& i ) const { return _ke.value(i); }
+    rvec3 ka( const isect& i ) const { return _ka.value(i); }
+    rvec3 ks( const isect& i ) const { return _ks.value(i); }
+    rvec3 kd( const isect& i ) const { return _kd.value(i); }
+    rvec3 kr( const isect& i ) const { return _kr.value(i); }
+    rvec3 kt( const isect& i ) const { return _kt.value(i); }
+    real shininess( const isect& i ) const
 	{
 		// Have to renormalize into the range 0-128 if it's texture mapped.
 		return _shininess.mapped() ? 
@@ -217,18 +245,18 @@ public:
 			_shininess.intensityValue(i);
 	}
 
-    double index( const isect& i ) const { return _index.intensityValue(i); }
+    real index( const isect& i ) const { return _index.intensityValue(i); }
 
-    // setting functions accepting primitives (glm::dvec3 and double)
-    void setEmissive( const glm::dvec3& ke )     { _ke.setValue( ke ); }
-    void setAmbient( const glm::dvec3& ka )      { _ka.setValue( ka ); }
-    void setSpecular( const glm::dvec3& ks )     { _ks.setValue( ks ); setBools(); }
-    void setDiffuse( const glm::dvec3& kd )      { _kd.setValue( kd ); }
-    void setReflective( const glm::dvec3& kr )   { _kr.setValue( kr ); setBools(); }
-    void setTransmissive( const glm::dvec3& kt ) { _kt.setValue( kt ); setBools(); }
-    void setShininess( double shininess )   
+    // setting functions accepting primitives (rvec3 and real)
+    void setEmissive( const rvec3& ke )     { _ke.setValue( ke ); }
+    void setAmbient( const rvec3& ka )      { _ka.setValue( ka ); }
+    void setSpecular( const rvec3& ks )     { _ks.setValue( ks ); setBools(); }
+    void setDiffuse( const rvec3& kd )      { _kd.setValue( kd ); }
+    void setReflective( const rvec3& kr )   { _kr.setValue( kr ); setBools(); }
+    void setTransmissive( const rvec3& kt ) { _kt.setValue( kt ); setBools(); }
+    void setShininess( real shininess )   
                                             { _shininess.setValue( shininess ); }
-    void setIndex( double index )           { _index.setValue( index ); }
+    void setIndex( real index )           { _index.setValue( index ); }
 
 
     // setting functions taking MaterialParameters
@@ -250,6 +278,8 @@ public:
 	bool Both() const { return _both; }
 
 private:
+    friend class SceneCache;
+
     MaterialParameter _ke;                    // emissive
     MaterialParameter _ka;                    // ambient
     MaterialParameter _ks;                    // specular
@@ -276,7 +306,7 @@ private:
 
 // This doesn't necessarily make sense for mapped materials
 inline Material
-operator*( double d, Material m )
+operator*( real d, Material m )
 {
     m._ke *= d;
     m._ka *= d;
@@ -12,6 +12,7 @@
 
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include "real.h"
 #include "material.h"
 #include "../ui/TraceUI.h"
 
@@ -30,22 +31,23 @@ public:
 		SHADOW
 	};
 
-	ray(const glm::dvec3 &pp,
-	    const glm::dvec3 &dd,
+	ray(const rvec3 &pp,
+	    const rvec3 &dd,
 	    unsigned char *px,
 	    unsigned int i,
-	    const glm::dvec3 &w,
+	    const rvec3 &w,
 	    RayType tt = VISIBILITY)
-		: p(pp), d(dd), pixel(px), ctr(i), atten(w), t(tt)
-	{ TraceUI::addRay(ctr); }
+		: p(pp), d(dd), ctr(i), pixel(px), atten(w), t(tt)
+	{ TraceUI::addRay(ctr, t); }
+	// copies are the same ray, so they are not counted again
 	ray(const ray& other)
 		: p(other.p),
 		  d(other.d),
-		  pixel(other.pixel),
 		  ctr(other.ctr),
+		  pixel(other.pixel),
 		  atten(other.atten),
 		  t(other.t)
-	{ TraceUI::addRay(ctr); }
+	{ }
 	~ray() {}
 
 	ray& operator =( const ray& other ) 
@@ -59,21 +61,21 @@ public:
 		return *this;
 	}
 
-	glm::dvec3 at( double t ) const
+	rvec3 at( real t ) const
 	{ return p + (t*d); }
 
-	glm::dvec3 getPosition() const { return p; }
-	glm::dvec3 getDirection() const { return d; }
+	rvec3 getPosition() const { return p; }
+	rvec3 getDirection() const { return d; }
 	unsigned char* getPixel() const { return pixel; }
-	glm::dvec3 getAtten() const { return atten; }
+	rvec3 getAtten() const { return atten; }
 	RayType type() const { return t; }
 
 public:
-	glm::dvec3 p;
-	glm::dvec3 d;
+	rvec3 p;
+	rvec3 d;
 	unsigned int ctr;
 	unsigned char* pixel;
-	glm::dvec3 atten;
+	rvec3 atten;
 	RayType t;
 };
 
@@ -83,60 +85,35 @@ public:
 class isect
 {
 public:
-    isect() : obj( NULL ), t( 0.0 ), N(), material(0) {}
-	isect(const isect& other)
-	{
-		obj = other.obj;
-		t = other.t;
-		N = other.N;
-		bary = other.bary;
-		uvCoordinates = other.uvCoordinates;
-		if (other.material) material = new Material(*other.material);
-		else material = 0;
-	}
-
-	~isect() { delete material; }
-    
-    isect& operator = (const isect& other) {
-        if( this != &other ) {
-            obj = other.obj;
-            t = other.t;
-            N = other.N;
-			bary = other.bary;
-            uvCoordinates = other.uvCoordinates;
-			if( other.material ) {
-                if( material ) *material = *other.material;
-                else material = new Material(*other.material );
-            }
-            else {
-                delete material;
-                material = 0;
-            }
-        }
-        return *this;
-    }
+    isect() : obj( NULL ), t( 0.0 ), N(), face( -1 ), material( 0 ) {}
 
     void setObject(const SceneObject *o) { obj = o; }
-    void setT(double tt) { t = tt; }
-    void setN(const glm::dvec3& n) { N = n; }
-    void setMaterial(const Material& m)  { if(material) *material = m; else material = new Material(m); }
-    void setUVCoordinates( const glm::dvec2& coords ) { uvCoordinates = coords; }
-    void setBary(const glm::dvec3& weights) { bary = weights; }
-    void setBary(const double alpha, const double beta, const double gamma)
+    void setT(real tt) { t = tt; }
+    void setN(const rvec3& n) { N = n; }
+    void setMaterial(const Material& m)  { material = &m; }
+    void setUVCoordinates( const rvec2& coords ) { uvCoordinates = coords; }
+    void setBary(const rvec3& weights) { bary = weights; }
+    void setBary(const real alpha, const real beta, const real gamma)
 		{ bary[0] = alpha; bary[1] = beta; bary[2] = gamma; }
+    // The material at the hit: the one set with setMaterial(), or else
+    // whatever the object gives for this hit (see SceneObject::materialAt()).
     const Material &getMaterial() const;
 
 public:
     const SceneObject *obj;
-    double t;
-    glm::dvec3 N;
-    glm::dvec2 uvCoordinates;
-    glm::dvec3 bary;
-    Material *material;         // if this intersection has its own material
-                                // (as opposed to one in its associated object)
-                                // as in the case where the material was interpolated
+    real t;
+    rvec3 N;
+    rvec2 uvCoordinates;
+    rvec3 bary;
+    int face;                   // face hit, for objects made of faces
+    const Material *material;   // not owned; isects copy freely
 };
 
-const double RAY_EPSILON = 0.00000001;
+// float cannot resolve offsets as small as the double build uses
+#ifdef RAY_FLOAT
+const real RAY_EPSILON = 0.0001;
+#else
+const real RAY_EPSILON = 0.00000001;
+#endif
 
 #endif // __RAY_H__
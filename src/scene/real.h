@@ -0,0 +1,42 @@
+//
+// real.h
+//
+// The scalar type the renderer works in, and the glm types built on it.
+//
+
+#ifndef __REAL_H__
+#define __REAL_H__
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <limits>
+
+// Rays, hits, bounds, geometry, transforms and materials all use real.
+// It is double by default, which is the build reference images come from;
+// configure with -DRAY_FLOAT=ON for a single precision build, which halves
+// the memory traversal touches and doubles the SIMD width.  The parser and
+// the UI stay in double and convert at the calls into the scene.
+//
+// glm only defines arithmetic between a vector and a scalar of the same
+// type, so constants next to real vectors are written real(2.0) and not
+// 2.0.
+#ifdef RAY_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// With real = double these are exactly glm::dvec2, glm::dvec3 and so on.
+typedef glm::tvec2<real, glm::highp> rvec2;
+typedef glm::tvec3<real, glm::highp> rvec3;
+typedef glm::tvec4<real, glm::highp> rvec4;
+typedef glm::tmat3x3<real, glm::highp> rmat3;
+typedef glm::tmat4x4<real, glm::highp> rmat4;
+
+// Largest finite real, for open-ended ray intervals.
+const real REAL_MAX = std::numeric_limits<real>::max();
+
+#endif // __REAL_H__
@@ -1,8 +1,10 @@
 #include <cmath>
+#include <atomic>
 
 #include "scene.h"
 #include "light.h"
 #include "kdTree.h"
+#include "bvh.h"
 #include "../ui/TraceUI.h"
 #include <glm/gtx/extented_min_max.hpp>
 #include <iostream>
@@ -10,31 +12,66 @@
 
 using namespace std;
 
-bool Geometry::intersect(ray& r, isect& i) const {
-	double tmin, tmax;
-	if (hasBoundingBoxCapability() && !(bounds.intersect(r, tmin, tmax))) return false;
-	// Transform the ray into the object's local coordinate space
-	glm::dvec3 pos = transform->globalToLocalCoords(r.p);
-	glm::dvec3 dir = transform->globalToLocalCoords(r.p + r.d) - pos;
-	double length = glm::length(dir);
-	dir = glm::normalize(dir);
-	glm::dvec3 Wpos = r.p;
-	glm::dvec3 Wdir = r.d;
-	r.p = pos;
-	r.d = dir;
-//	ray localRay(pos, dir, r.pixel, r.ctr, r.atten, r.t);
-//	if (intersectLocal(localRay, i))
-	bool rtrn = false;
-	if (intersectLocal(r, i))
-	{
-		// Transform the intersection point & normal returned back into global space.
-		i.N = transform->localToGlobalCoordsNormal(i.N);
-		i.t /= length;
-		rtrn = true;
+void TransformNode::classify() {
+	rmat3 linear(xform);
+	rvec3 offset(xform[3]);
+	rmat3 identity(1.0);
+	invLinear = rmat3(inverse);
+	invOffset = rvec3(inverse[3]);
+	invScale = 1.0;
+
+	if (xform[0][3] != 0.0 || xform[1][3] != 0.0 || xform[2][3] != 0.0 || xform[3][3] != 1.0) {
+		xformKind = PROJECTIVE;
+		return;
+	}
+	if (linear == identity) {
+		xformKind = offset == rvec3(0.0) ? IDENTITY : TRANSLATION;
+		return;
 	}
-	r.p = Wpos;
-	r.d = Wdir;
-	return rtrn;
+
+	// a rotation with uniform scale s has columns of length s that are
+	// orthogonal to each other, i.e. L^T L = s^2 I
+	rmat3 gram = glm::transpose(linear) * linear;
+	real s2 = gram[0][0];
+	const real tolerance = sizeof(real) < sizeof(double) ? 1e-5 : 1e-12;
+	xformKind = UNIFORM_SCALE;
+	for (int c = 0; c < 3; c++)
+		for (int r = 0; r < 3; r++)
+			if (std::abs(gram[c][r] - (c == r ? s2 : 0.0)) > tolerance * s2)
+				xformKind = AFFINE;
+	if (xformKind == UNIFORM_SCALE)
+		invScale = 1.0 / std::sqrt(s2);
+}
+
+bool Geometry::intersect(const ray& r, isect& i) const {
+	TraceUI::addTest(r.ctr);
+	real tmin, tmax;
+	if (hasBoundingBoxCapability() && !(bounds.intersect(r, tmin, tmax))) return false;
+	// Take the ray into the object's local coordinate space
+	ray local(r);
+	real length;
+	transform->globalToLocalRay(r.p, r.d, local.p, local.d, length);
+	if (!intersectLocal(local, i)) return false;
+	// Transform the intersection normal & distance back into global space.
+	i.N = transform->localToGlobalCoordsNormal(i.N);
+	i.t /= length;
+	return true;
+}
+
+bool Geometry::occluded(const ray& r, real tmax) const {
+	TraceUI::addTest(r.ctr);
+	real tmin, tmaxBox;
+	if (hasBoundingBoxCapability() && !(bounds.intersect(r, tmin, tmaxBox) && tmin < tmax)) return false;
+	// same local ray as intersect(), with tmax scaled to its units
+	ray local(r);
+	real length;
+	transform->globalToLocalRay(r.p, r.d, local.p, local.d, length);
+	return occludedLocal(local, tmax * length);
+}
+
+bool Geometry::occludedLocal(const ray& r, real tmax) const {
+	isect i;
+	return intersectLocal(r, i) && i.t < tmax;
 }
 
 bool Geometry::hasBoundingBoxCapability() const {
@@ -55,38 +92,48 @@ void Geometry::ComputeBoundingBox() {
 
     BoundingBox localBounds = ComputeLocalBoundingBox();
         
-    glm::dvec3 min = localBounds.getMin();
-    glm::dvec3 max = localBounds.getMax();
+    rvec3 min = localBounds.getMin();
+    rvec3 max = localBounds.getMax();
 
-    glm::dvec4 v, newMax, newMin;
+    rvec4 v, newMax, newMin;
 
-    v = transform->localToGlobalCoords( glm::dvec4(min[0], min[1], min[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(min[0], min[1], min[2], 1) );
     newMax = v;
     newMin = v;
-    v = transform->localToGlobalCoords( glm::dvec4(max[0], min[1], min[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(max[0], min[1], min[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(min[0], max[1], min[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(min[0], max[1], min[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(max[0], max[1], min[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(max[0], max[1], min[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(min[0], min[1], max[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(min[0], min[1], max[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(max[0], min[1], max[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(max[0], min[1], max[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(min[0], max[1], max[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(min[0], max[1], max[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
-    v = transform->localToGlobalCoords( glm::dvec4(max[0], max[1], max[2], 1) );
+    v = transform->localToGlobalCoords( rvec4(max[0], max[1], max[2], 1) );
     newMax = glm::max(newMax, v);
     newMin = glm::min(newMin, v);
 		
-    bounds.setMax(glm::dvec3(newMax));
-    bounds.setMin(glm::dvec3(newMin));
+    bounds.setMax(rvec3(newMax));
+    bounds.setMin(rvec3(newMin));
+}
+
+unsigned Scene::nextSerial() {
+	static std::atomic<unsigned> counter(0);
+	return ++counter;
+}
+
+void Scene::add(Light* light) {
+	light->setIndex((int)lights.size());
+	lights.push_back(light);
 }
 
 Scene::~Scene() {
@@ -96,17 +143,68 @@ Scene::~Scene() {
 	for( g = objects.begin(); g != objects.end(); ++g ) delete (*g);
 	for( l = lights.begin(); l != lights.end(); ++l ) delete (*l);
 	for( t = textureCache.begin(); t != textureCache.end(); t++ ) delete (*t).second;
+	delete kdtree;
+	delete bvh;
+}
+
+void Scene::buildKdTree(int maxDepth, int leafSize) {
+	if (kdtree && kdtree->maxDepth() == maxDepth && kdtree->leafSize() == leafSize) return;
+	delete kdtree;
+	kdtree = new KdTree<Geometry>();
+	kdtree->build(boundedobjects, maxDepth, leafSize);
+}
+
+void Scene::clearKdTree() {
+	delete kdtree;
+	kdtree = 0;
 }
 
 
+void Scene::buildBVH() {
+	if (bvh) return;
+	std::vector<BoundingBox> objectBounds;
+	objectBounds.reserve(boundedobjects.size());
+	for (cgiter j = boundedobjects.begin(); j != boundedobjects.end(); ++j)
+		objectBounds.push_back((*j)->getBoundingBox());
+
+	bvh = new BVH();
+	bvh->build(objectBounds, 1);
+	const std::vector<int>& order = bvh->order();
+	bvhobjects.resize(order.size());
+	for (size_t k = 0; k < order.size(); k++)
+		bvhobjects[k] = boundedobjects[order[k]];
+}
+
+void Scene::clearBVH() {
+	delete bvh;
+	bvh = 0;
+	bvhobjects.clear();
+}
+
 // Get any intersection with an object.  Return information about the 
 // intersection through the reference parameter.
-bool Scene::intersect(ray& r, isect& i) const {
-	double tmin = 0.0;
-	double tmax = 0.0;
+bool Scene::intersect(const ray& r, isect& i) const {
 	bool have_one = false;
 	typedef vector<Geometry*>::const_iterator iter;
-	for(iter j = objects.begin(); j != objects.end(); ++j) {
+	// With a kd-tree or BVH only the unbounded objects need to be tested
+	// one by one.
+	const vector<Geometry*>& linear = (kdtree || bvh) ? nonboundedobjects : objects;
+	if (kdtree) have_one = kdtree->intersect(r, i);
+	else if (bvh) {
+		real tmax = REAL_MAX;
+		bvh->traverse(r.getPosition(), r.getDirection(), tmax, [&](int first, int count) {
+			for (int k = first; k < first + count; k++) {
+				isect cur;
+				if (bvhobjects[k]->intersect(r, cur) && (!have_one || cur.t < i.t)) {
+					i = cur;
+					have_one = true;
+					tmax = cur.t;
+				}
+			}
+			return false;
+		});
+	}
+	for(iter j = linear.begin(); j != linear.end(); ++j) {
 		isect cur;
 		if( (*j)->intersect(r, cur) ) {
 			if(!have_one || (cur.t < i.t)) {
@@ -121,10 +219,76 @@ bool Scene::intersect(ray& r, isect& i) const {
 	return have_one;
 }
 
+void Scene::intersect(const ray* rays, int n, isect* hits, bool* found) const {
+	bool shared = bvh && !kdtree && !TraceUI::m_debug && n <= BVH::MAX_PACKET;
+	for (int k = 1; k < n && shared; k++)
+		shared = rays[k].p == rays[0].p;
+
+	rvec3 dirs[BVH::MAX_PACKET];
+	real tmax[BVH::MAX_PACKET];
+	if (shared) {
+		for (int k = 0; k < n; k++) {
+			dirs[k] = rays[k].d;
+			tmax[k] = REAL_MAX;
+			found[k] = false;
+		}
+		shared = bvh->traversePacket(rays[0].p, dirs, n, tmax, [&](int first, int count, unsigned mask) {
+			for (int o = first; o < first + count; o++)
+				for (int k = 0; k < n; k++) {
+					isect cur;
+					if ((mask & (1u << k)) && bvhobjects[o]->intersect(rays[k], cur) &&
+						(!found[k] || cur.t < hits[k].t)) {
+						hits[k] = cur;
+						found[k] = true;
+						tmax[k] = cur.t;
+					}
+				}
+			return false;
+		});
+	}
+	if (!shared) {
+		for (int k = 0; k < n; k++)
+			found[k] = intersect(rays[k], hits[k]);
+		return;
+	}
+
+	for (int k = 0; k < n; k++) {
+		for (cgiter j = nonboundedobjects.begin(); j != nonboundedobjects.end(); ++j) {
+			isect cur;
+			if ((*j)->intersect(rays[k], cur) && (!found[k] || cur.t < hits[k].t)) {
+				hits[k] = cur;
+				found[k] = true;
+			}
+		}
+		if (!found[k]) hits[k].setT(1000.0);
+	}
+}
+
+bool Scene::occluded(const ray& r, real tmax, const Geometry** blocker) const {
+	typedef vector<Geometry*>::const_iterator iter;
+	const Geometry* found = 0;
+	const vector<Geometry*>& linear = (kdtree || bvh) ? nonboundedobjects : objects;
+	for(iter j = linear.begin(); j != linear.end() && !found; ++j)
+		if ((*j)->occluded(r, tmax)) found = *j;
+
+	if (!found && kdtree) {
+		kdtree->occluded(r, tmax, &found);
+	} else if (!found && bvh) {
+		real tcull = tmax;
+		bvh->traverse(r.getPosition(), r.getDirection(), tcull, [&](int first, int count) {
+			for (int k = first; k < first + count && !found; k++)
+				if (bvhobjects[k]->occluded(r, tmax)) found = bvhobjects[k];
+			return found != 0;
+		});
+	}
+	if (found && blocker) *blocker = found;
+	return found != 0;
+}
+
 TextureMap* Scene::getTexture(string name) {
 	tmap::const_iterator itr = textureCache.find(name);
 	if(itr == textureCache.end()) {
-		textureCache[name] = new TextureMap(name);
+		textureCache[name] = new TextureMap(name, pool);
 		return textureCache[name];
 	} else return (*itr).second;
 }
@@ -33,6 +33,8 @@ class Scene;
 
 template <typename Obj>
 class KdTree;
+class BVH;
+class ThreadPool;
 
 class SceneElement {
 
@@ -51,21 +53,35 @@ public:
   Scene *scene;
 };
 
-inline glm::dvec3 operator * (const glm::dmat4x4& mat, const glm::dvec3& vec)
+inline rvec3 operator * (const rmat4& mat, const rvec3& vec)
 {
-	glm::dvec4 vec4(vec[0], vec[1], vec[2], 1.0);
+	rvec4 vec4(vec[0], vec[1], vec[2], 1.0);
 	auto ret = mat * vec4;
-	return glm::dvec3(ret[0], ret[1], ret[2]);
+	return rvec3(ret[0], ret[1], ret[2]);
 }
 
 class TransformNode {
 
+public:
+  // What kind of map xform is, worked out once when the node is created
+  // so that rays can be taken to local space with as little work as
+  // possible.  UNIFORM_SCALE is a rotation and uniform scale, and all
+  // but PROJECTIVE may include a translation.
+  enum Kind { IDENTITY, TRANSLATION, UNIFORM_SCALE, AFFINE, PROJECTIVE };
+
 protected:
 
   // information about this node's transformation
-	glm::dmat4x4    xform;
-	glm::dmat4x4 inverse;
-	glm::dmat3x3 normi;
+	rmat4    xform;
+	rmat4 inverse;
+	rmat3 normi;
+
+  // the inverse split into a linear part and an offset, for all but
+  // PROJECTIVE, and the inverse's scale factor for UNIFORM_SCALE
+  Kind xformKind;
+  rmat3 invLinear;
+  rvec3 invOffset;
+  real invScale;
 
   // information about parent & children
   TransformNode *parent;
@@ -79,41 +95,82 @@ protected:
       for(child_iter c = children.begin(); c != children.end(); ++c ) delete (*c);
     }
 
-  TransformNode *createChild(const glm::dmat4x4& xform) {
+  TransformNode *createChild(const rmat4& xform) {
     TransformNode *child = new TransformNode(this, xform);
     children.push_back(child);
     return child;
   }
     
   // Coordinate-Space transformation
-  glm::dvec3 globalToLocalCoords(const glm::dvec3 &v) { return inverse * v; }
+  rvec3 globalToLocalCoords(const rvec3 &v) const { return inverse * v; }
 
-  glm::dvec3 localToGlobalCoords(const glm::dvec3 &v) { return xform * v; }
+  rvec3 localToGlobalCoords(const rvec3 &v) const { return xform * v; }
 
-  glm::dvec4 localToGlobalCoords(const glm::dvec4 &v) { return xform * v; }
+  rvec4 localToGlobalCoords(const rvec4 &v) const { return xform * v; }
 
-  glm::dvec3 localToGlobalCoordsNormal(const glm::dvec3 &v) {
+  rvec3 localToGlobalCoordsNormal(const rvec3 &v) const {
+	  if (xformKind <= TRANSLATION) return glm::normalize(v);
 	  return glm::normalize(normi * v);
   }
 
-  const glm::dmat4x4& transform() const		{ return xform; }
+  // Take the global ray p + t*d to local space as pos + s*dir, with dir
+  // normalized.  A local hit at s is at t = s / length.
+  void globalToLocalRay(const rvec3& p, const rvec3& d,
+                        rvec3& pos, rvec3& dir, real& length) const {
+    switch (xformKind) {
+    case IDENTITY:
+      pos = p;
+      length = glm::length(d);
+      dir = d / length;
+      break;
+    case TRANSLATION:
+      pos = p + invOffset;
+      length = glm::length(d);
+      dir = d / length;
+      break;
+    case UNIFORM_SCALE:
+      pos = invLinear * p + invOffset;
+      length = glm::length(d) * invScale;
+      dir = (invLinear * d) / length;
+      break;
+    case AFFINE:
+      pos = invLinear * p + invOffset;
+      dir = invLinear * d;
+      length = glm::length(dir);
+      dir /= length;
+      break;
+    default:
+      pos = inverse * p;
+      dir = inverse * (p + d) - pos;
+      length = glm::length(dir);
+      dir /= length;
+      break;
+    }
+  }
+
+  Kind kind() const { return xformKind; }
+  const rmat4& transform() const		{ return xform; }
 
 protected:
   // protected so that users can't directly construct one of these...
   // force them to use the createChild() method.  Note that they CAN
   // directly create a TransformRoot object.
- TransformNode(TransformNode *parent, const glm::dmat4x4& xform ) : children() {
+ TransformNode(TransformNode *parent, const rmat4& xform ) : children() {
       this->parent = parent;
       if (parent == NULL) this->xform = xform;
       else this->xform = parent->xform * xform;  
       inverse = glm::inverse(this->xform);
-      normi = glm::transpose(glm::inverse(glm::dmat3x3(this->xform)));
+      normi = glm::transpose(glm::inverse(rmat3(this->xform)));
+      classify();
     }
+
+ private:
+  void classify();
 };
 
 class TransformRoot : public TransformNode {
  public:
- TransformRoot() : TransformNode(NULL, glm::dmat4x4(1.0)) {}
+ TransformRoot() : TransformNode(NULL, rmat4(1.0)) {}
 };
 
 // A Geometry object is anything that has extent in three dimensions.
@@ -124,15 +181,25 @@ class Geometry : public SceneElement {
 protected:
   // intersections performed in the object's local coordinate space
   // do not call directly - this should only be called by intersect()
-  virtual bool intersectLocal(ray& r, isect& i ) const = 0;
+  virtual bool intersectLocal(const ray& r, isect& i ) const = 0;
+
+  // Is there any hit along r (in local space) closer than tmax?  The
+  // default just runs intersectLocal(); objects that can stop at the
+  // first hit they find should override it.
+  virtual bool occludedLocal(const ray& r, real tmax) const;
 
 public:
   // intersections performed in the global coordinate space.
-  bool intersect(ray& r, isect& i) const;
+  bool intersect(const ray& r, isect& i) const;
+
+  // Any-hit query in the global coordinate space: is there a hit along r
+  // with t < tmax?  Cheaper than intersect() as it fills in no isect.
+  bool occluded(const ray& r, real tmax) const;
 
   virtual bool hasBoundingBoxCapability() const;
   const BoundingBox& getBoundingBox() const { return bounds; }
-  glm::dvec3 getNormal() { return glm::dvec3(1.0, 0.0, 0.0); }
+  const TransformNode* getTransform() const { return transform; }
+  rvec3 getNormal() { return rvec3(1.0, 0.0, 0.0); }
 
   virtual void ComputeBoundingBox();
 
@@ -166,6 +233,11 @@ class SceneObject : public Geometry {
   virtual const Material& getMaterial() const = 0;
   virtual void setMaterial(Material *m) = 0;
 
+  // The material at hit i, for hits that did not set one.  Objects with
+  // varying materials may return per-thread scratch storage, which stays
+  // valid only until the next call on the same thread.
+  virtual const Material& materialAt(const isect& i) const { return getMaterial(); }
+
   void glDraw(int quality, bool actualMaterials, bool actualTextures) const;
 
  protected:
@@ -200,17 +272,50 @@ public:
 
   TransformRoot transformRoot;
 
-  Scene() : transformRoot(), objects(), lights() {}
+  Scene() : transformRoot(), objects(), lights(), pool(0), kdtree(0), bvh(0), serial(nextSerial()) {}
   virtual ~Scene();
 
   void add( Geometry* obj ) {
     obj->ComputeBoundingBox();
 	sceneBounds.merge(obj->getBoundingBox());
     objects.push_back(obj);
+    if (obj->hasBoundingBoxCapability()) boundedobjects.push_back(obj);
+    else nonboundedobjects.push_back(obj);
   }
-  void add(Light* light) { lights.push_back(light); }
-
-  bool intersect(ray& r, isect& i) const;
+  void add(Light* light);
+
+  // Distinct for every Scene created, so per-thread caches can tell
+  // whether they still refer to this scene.
+  unsigned getSerial() const { return serial; }
+
+  bool intersect(const ray& r, isect& i) const;
+
+  // intersect() for n rays at once, e.g. a packet of primary rays: found[k]
+  // and hits[k] are what intersect(rays[k], hits[k]) would give.  Rays that
+  // share an origin go through the BVH together (see BVH::traversePacket());
+  // anything else is traced one ray at a time.
+  void intersect(const ray* rays, int n, isect* hits, bool* found) const;
+
+  // Does anything block r before t = tmax?  Used for shadow rays: stops
+  // at the first hit found, whichever it is, and never builds an isect.
+  // The blocking object is stored in *blocker if it is given.
+  bool occluded(const ray& r, real tmax, const Geometry** blocker = 0) const;
+
+  // Build the kd-tree over the bounded objects.  Does nothing if a tree
+  // with the same parameters already exists, so it is cheap to call
+  // before every render.
+  void buildKdTree(int maxDepth, int leafSize);
+  // Drop the kd-tree; intersect() then falls back to testing every object.
+  void clearKdTree();
+  bool hasKdTree() const { return kdtree != 0; }
+
+  // Build the top-level BVH over the world-space bounds of the bounded
+  // objects.  Its leaves are whole objects, which intersect in their own
+  // local space (a Trimesh through its shared face BVH), so only this
+  // level depends on the transforms.  Used when there is no kd-tree;
+  // does nothing if it is already built.
+  void buildBVH();
+  void clearBVH();
 
   std::vector<Light*>::const_iterator beginLights() const { return lights.begin(); }
   std::vector<Light*>::const_iterator endLights() const { return lights.end(); }
@@ -223,14 +328,18 @@ public:
 
   // For efficiency reasons, we'll store texture maps in a cache
   // in the Scene.  This makes sure they get deleted when the scene
-  // is destroyed.
+  // is destroyed.  With a thread pool set, a new map's pixels are
+  // decoded on the pool while the caller carries on, so a PNG that is
+  // damaged past its header is reported on cerr and renders white
+  // instead of throwing TextureMapException here (see TextureMap).
   TextureMap* getTexture( string name );
+  void setThreadPool( ThreadPool* p ) { pool = p; }
 
   // These two functions are for handling ambient light; in the Phong model,
   // the "ambient" light is considered a property of the _scene_ as a whole
   // and hence should be set here.
-  glm::dvec3 ambient() const	{ return ambientIntensity; }
-  void addAmbient( const glm::dvec3& ambient ) { ambientIntensity += ambient; }
+  rvec3 ambient() const	{ return ambientIntensity; }
+  void addAmbient( const rvec3& ambient ) { ambientIntensity += ambient; }
 
   void glDraw(int quality, bool actualMaterials, bool actualTextures) const;
 
@@ -246,10 +355,11 @@ public:
 
   // This is the total amount of ambient light in the scene
   // (used as the I_a in the Phong shading model)
-  glm::dvec3 ambientIntensity;
+  rvec3 ambientIntensity;
 
   typedef std::map< std::string, TextureMap* > tmap;
   tmap textureCache;
+  ThreadPool* pool;
 	
   // Each object in the scene, provided that it has hasBoundingBoxCapability(),
   // must fall within this bounding box.  Objects that don't have hasBoundingBoxCapability()
@@ -257,6 +367,12 @@ public:
   BoundingBox sceneBounds;
   
   KdTree<Geometry>* kdtree;
+  BVH* bvh;
+  // boundedobjects in BVH leaf order
+  std::vector<Geometry*> bvhobjects;
+
+  unsigned serial;
+  static unsigned nextSerial();
 
  public:
   // This is used for debugging purposes only.
@@ -0,0 +1,546 @@
+#include "sceneCache.h"
+
+#include "scene.h"
+#include "light.h"
+#include "bvh.h"
+#include "../SceneObjects/Box.h"
+#include "../SceneObjects/Cone.h"
+#include "../SceneObjects/Cylinder.h"
+#include "../SceneObjects/Sphere.h"
+#include "../SceneObjects/Square.h"
+#include "../SceneObjects/trimesh.h"
+#include "../fileio/mappedfile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <typeinfo>
+
+using namespace std;
+
+namespace {
+
+const char magic[8] = { 'R', 'A', 'Y', 'S', 'C', 'E', 'N', 'E' };
+// Bump whenever the layout of the file, or of anything stored in it byte
+// for byte (rvec3, rmat4, BVH::Node), changes.
+const uint32_t version = 1;
+const uint32_t byteOrderMark = 0x01020304;
+
+enum ObjectKind { OBJ_SPHERE, OBJ_BOX, OBJ_SQUARE, OBJ_CYLINDER, OBJ_CONE, OBJ_TRIMESH };
+enum LightKind { LIGHT_POINT, LIGHT_DIRECTIONAL };
+
+}
+
+// Appends to the cache file.  Transforms and meshes are written in full the
+// first time an object uses them and by index after that.
+class SceneCache::Writer {
+public:
+	Writer(FILE* f, const string& base) : file(f), basePath(base), ok(true) {}
+
+	void putBytes(const void* p, size_t n)
+	{
+		if (ok && n > 0 && fwrite(p, 1, n, file) != n) ok = false;
+	}
+	template <class T> void put(const T& v) { putBytes(&v, sizeof(T)); }
+	template <class T> void putVector(const vector<T>& v)
+	{
+		put<uint64_t>(v.size());
+		if (!v.empty()) putBytes(&v[0], v.size() * sizeof(T));
+	}
+	void putString(const string& s)
+	{
+		put<uint32_t>((uint32_t)s.size());
+		putBytes(s.data(), s.size());
+	}
+	// A file name, relative to basePath if it is under it.
+	void putName(const string& name)
+	{
+		string prefix = basePath + "/";
+		bool relative = !basePath.empty() && name.compare(0, prefix.size(), prefix) == 0;
+		put<uint8_t>(relative);
+		putString(relative ? name.substr(prefix.size()) : name);
+	}
+
+	bool good() const { return ok; }
+
+	map<const TransformNode*, int32_t> transforms;
+	map<const TrimeshData*, int32_t> meshes;
+
+private:
+	FILE* file;
+	string basePath;
+	bool ok;
+};
+
+// Reads the cache back.  Running off the end or finding a bad index clears
+// good() and makes every later read return zeros.
+class SceneCache::Reader {
+public:
+	Reader(const char* data, size_t size, const string& base)
+		: next(data), end(data + size), basePath(base), ok(true) {}
+
+	void getBytes(void* p, size_t n)
+	{
+		if (!ok || (size_t)(end - next) < n) {
+			ok = false;
+			memset(p, 0, n);
+			return;
+		}
+		memcpy(p, next, n);
+		next += n;
+	}
+	template <class T> T get()
+	{
+		T v;
+		getBytes(&v, sizeof(T));
+		return v;
+	}
+	template <class T> void getVector(vector<T>& v)
+	{
+		uint64_t n = get<uint64_t>();
+		if (!ok || n > (uint64_t)(end - next) / sizeof(T)) {
+			ok = false;
+			v.clear();
+			return;
+		}
+		v.resize((size_t)n);
+		if (n > 0) getBytes(&v[0], (size_t)n * sizeof(T));
+	}
+	string getString()
+	{
+		uint32_t n = get<uint32_t>();
+		if (!ok || n > (size_t)(end - next)) {
+			ok = false;
+			return string();
+		}
+		string s(next, n);
+		next += n;
+		return s;
+	}
+	string getName()
+	{
+		bool relative = get<uint8_t>() != 0;
+		string name = getString();
+		return relative ? basePath + "/" + name : name;
+	}
+
+	void fail() { ok = false; }
+	bool good() const { return ok; }
+	bool atEnd() const { return next == end; }
+
+	vector<TransformNode*> transforms;
+	vector<shared_ptr<TrimeshData> > meshes;
+
+private:
+	const char* next;
+	const char* end;
+	string basePath;
+	bool ok;
+};
+
+uint64_t SceneCache::hash(const char* data, size_t n)
+{
+	const uint64_t prime = 1099511628211ULL;
+	uint64_t h = 14695981039346656037ULL;
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8) {
+		uint64_t word;
+		memcpy(&word, data + k, 8);
+		h = (h ^ word) * prime;
+	}
+	for (; k < n; k++)
+		h = (h ^ (unsigned char)data[k]) * prime;
+	return h;
+}
+
+string SceneCache::pathFor(const string& sceneFile)
+{
+	return sceneFile + ".cache";
+}
+
+bool SceneCache::write(const string& path, const string& basePath,
+	const Scene& scene, uint64_t sourceHash, const vector<string>& dependencies)
+{
+	string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file) return false;
+
+	Writer w(file, basePath);
+	w.putBytes(magic, sizeof(magic));
+	w.put(version);
+	w.put<uint32_t>(sizeof(real));
+	w.put(byteOrderMark);
+	w.put<uint32_t>(sizeof(BVH::Node));
+	w.put(sourceHash);
+
+	bool ok = true;
+	w.put<uint32_t>((uint32_t)dependencies.size());
+	for (size_t k = 0; k < dependencies.size() && ok; k++) {
+		MappedFile dependency;
+		if (!dependency.open(dependencies[k])) {
+			ok = false;
+			break;
+		}
+		w.putName(dependencies[k]);
+		w.put(hash(dependency.data(), dependency.size()));
+	}
+
+	ok = ok && writeScene(w, scene) && w.good();
+	if (fclose(file) != 0) ok = false;
+	if (ok) {
+#ifdef _WIN32
+		// rename() does not replace an existing file here
+		remove(path.c_str());
+#endif
+		ok = rename(temp.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) remove(temp.c_str());
+	return ok;
+}
+
+Scene* SceneCache::read(const string& path, const string& basePath, uint64_t sourceHash,
+	ThreadPool* pool)
+{
+	MappedFile file;
+	if (!file.open(path)) return 0;
+
+	Reader r(file.data(), file.size(), basePath);
+	char tag[sizeof(magic)];
+	r.getBytes(tag, sizeof(tag));
+	if (memcmp(tag, magic, sizeof(magic)) != 0 ||
+		r.get<uint32_t>() != version ||
+		r.get<uint32_t>() != sizeof(real) ||
+		r.get<uint32_t>() != byteOrderMark ||
+		r.get<uint32_t>() != sizeof(BVH::Node) ||
+		r.get<uint64_t>() != sourceHash)
+		return 0;
+
+	uint32_t count = r.get<uint32_t>();
+	for (uint32_t k = 0; k < count && r.good(); k++) {
+		string name = r.getName();
+		uint64_t expected = r.get<uint64_t>();
+		MappedFile dependency;
+		if (!r.good() || !dependency.open(name) ||
+			hash(dependency.data(), dependency.size()) != expected)
+			return 0;
+	}
+	if (!r.good()) return 0;
+
+	unique_ptr<Scene> scene(new Scene);
+	scene->setThreadPool(pool);
+	if (!readScene(r, scene.get()) || !r.good() || !r.atEnd()) return 0;
+	return scene.release();
+}
+
+bool SceneCache::writeScene(Writer& w, const Scene& scene)
+{
+	const Camera& camera = scene.getCamera();
+	w.put(camera.m);
+	w.put(camera.normalizedHeight);
+	w.put(camera.aspectRatio);
+	w.put(camera.eye);
+	w.put(camera.look);
+	w.put(camera.u);
+	w.put(camera.v);
+	w.put(scene.ambient());
+
+	w.put<uint32_t>((uint32_t)(scene.endLights() - scene.beginLights()));
+	for (Scene::cliter l = scene.beginLights(); l != scene.endLights(); ++l) {
+		if (typeid(**l) == typeid(PointLight)) {
+			const PointLight* light = static_cast<const PointLight*>(*l);
+			w.put<uint8_t>(LIGHT_POINT);
+			w.put(light->position);
+			w.put(light->color);
+			w.put(light->constantTerm);
+			w.put(light->linearTerm);
+			w.put(light->quadraticTerm);
+		} else if (typeid(**l) == typeid(DirectionalLight)) {
+			const DirectionalLight* light = static_cast<const DirectionalLight*>(*l);
+			w.put<uint8_t>(LIGHT_DIRECTIONAL);
+			w.put(light->orientation);
+			w.put(light->color);
+		} else {
+			return false;
+		}
+	}
+
+	w.put<uint32_t>((uint32_t)(scene.endObjects() - scene.beginObjects()));
+	for (Scene::cgiter g = scene.beginObjects(); g != scene.endObjects(); ++g) {
+		const Geometry* obj = *g;
+		const type_info& type = typeid(*obj);
+		uint8_t kind;
+		if (type == typeid(Sphere)) kind = OBJ_SPHERE;
+		else if (type == typeid(Box)) kind = OBJ_BOX;
+		else if (type == typeid(Square)) kind = OBJ_SQUARE;
+		else if (type == typeid(Cylinder)) kind = OBJ_CYLINDER;
+		else if (type == typeid(Cone)) kind = OBJ_CONE;
+		else if (type == typeid(Trimesh)) kind = OBJ_TRIMESH;
+		else return false;
+
+		w.put(kind);
+		writeTransform(w, obj->getTransform());
+		writeMaterial(w, static_cast<const MaterialSceneObject*>(obj)->getMaterial());
+		if (kind == OBJ_CYLINDER) {
+			const Cylinder* cylinder = static_cast<const Cylinder*>(obj);
+			w.put<uint8_t>(cylinder->capped);
+		} else if (kind == OBJ_CONE) {
+			const Cone* cone = static_cast<const Cone*>(obj);
+			w.put(cone->height);
+			w.put(cone->b_radius);
+			w.put(cone->t_radius);
+			w.put<uint8_t>(cone->capped);
+		} else if (kind == OBJ_TRIMESH) {
+			writeMesh(w, static_cast<const Trimesh*>(obj)->getMesh());
+		}
+	}
+	return true;
+}
+
+bool SceneCache::readScene(Reader& r, Scene* scene)
+{
+	Camera& camera = scene->getCamera();
+	camera.m = r.get<rmat3>();
+	camera.normalizedHeight = r.get<real>();
+	camera.aspectRatio = r.get<real>();
+	camera.eye = r.get<rvec3>();
+	camera.look = r.get<rvec3>();
+	camera.u = r.get<rvec3>();
+	camera.v = r.get<rvec3>();
+	scene->addAmbient(r.get<rvec3>());
+
+	uint32_t lights = r.get<uint32_t>();
+	for (uint32_t k = 0; k < lights && r.good(); k++) {
+		uint8_t kind = r.get<uint8_t>();
+		if (kind == LIGHT_POINT) {
+			rvec3 position = r.get<rvec3>();
+			rvec3 color = r.get<rvec3>();
+			float a = r.get<float>();
+			float b = r.get<float>();
+			float c = r.get<float>();
+			if (r.good()) scene->add(new PointLight(scene, position, color, a, b, c));
+		} else if (kind == LIGHT_DIRECTIONAL) {
+			rvec3 orientation = r.get<rvec3>();
+			rvec3 color = r.get<rvec3>();
+			if (r.good()) {
+				DirectionalLight* light = new DirectionalLight(scene, orientation, color);
+				// already normalized once; normalizing again may move it by an ulp
+				light->orientation = orientation;
+				scene->add(light);
+			}
+		} else {
+			r.fail();
+		}
+	}
+
+	uint32_t objects = r.get<uint32_t>();
+	for (uint32_t k = 0; k < objects && r.good(); k++) {
+		uint8_t kind = r.get<uint8_t>();
+		TransformNode* transform = readTransform(r, scene);
+		unique_ptr<Material> mat(readMaterial(r, scene));
+		if (!r.good()) break;
+
+		MaterialSceneObject* obj = 0;
+		switch (kind) {
+		case OBJ_SPHERE:
+			obj = new Sphere(scene, mat.release());
+			break;
+		case OBJ_BOX:
+			obj = new Box(scene, mat.release());
+			break;
+		case OBJ_SQUARE:
+			obj = new Square(scene, mat.release());
+			break;
+		case OBJ_CYLINDER: {
+			bool capped = r.get<uint8_t>() != 0;
+			if (!r.good()) break;
+			Cylinder* cylinder = new Cylinder(scene, mat.release());
+			cylinder->capped = capped;
+			obj = cylinder;
+			break;
+		}
+		case OBJ_CONE: {
+			real height = r.get<real>();
+			real bottom = r.get<real>();
+			real top = r.get<real>();
+			bool capped = r.get<uint8_t>() != 0;
+			if (!r.good()) break;
+			obj = new Cone(scene, mat.release(), height, bottom, top, capped);
+			break;
+		}
+		case OBJ_TRIMESH: {
+			shared_ptr<TrimeshData> mesh = readMesh(r, scene);
+			if (!mesh) break;
+			Trimesh* trimesh = new Trimesh(scene, mat.release(), transform);
+			trimesh->shareMesh(mesh);
+			obj = trimesh;
+			break;
+		}
+		default:
+			r.fail();
+			break;
+		}
+		if (!obj) return false;
+		obj->setTransform(transform);
+		scene->add(obj);
+	}
+	return r.good();
+}
+
+void SceneCache::writeMaterial(Writer& w, const Material& m)
+{
+	writeParameter(w, m._ke);
+	writeParameter(w, m._ka);
+	writeParameter(w, m._ks);
+	writeParameter(w, m._kd);
+	writeParameter(w, m._kr);
+	writeParameter(w, m._kt);
+	writeParameter(w, m._shininess);
+	writeParameter(w, m._index);
+}
+
+Material* SceneCache::readMaterial(Reader& r, Scene* scene)
+{
+	Material* m = new Material;
+	readParameter(r, scene, m->_ke);
+	readParameter(r, scene, m->_ka);
+	readParameter(r, scene, m->_ks);
+	readParameter(r, scene, m->_kd);
+	readParameter(r, scene, m->_kr);
+	readParameter(r, scene, m->_kt);
+	readParameter(r, scene, m->_shininess);
+	readParameter(r, scene, m->_index);
+	m->setBools();
+	return m;
+}
+
+void SceneCache::writeParameter(Writer& w, const MaterialParameter& p)
+{
+	w.put(p._value);
+	w.put<uint8_t>(p._textureMap != 0);
+	if (p._textureMap) w.putName(p._textureMap->getFilename());
+}
+
+void SceneCache::readParameter(Reader& r, Scene* scene, MaterialParameter& p)
+{
+	p._value = r.get<rvec3>();
+	p._textureMap = 0;
+	if (r.get<uint8_t>()) {
+		string name = r.getName();
+		if (r.good()) p._textureMap = scene->getTexture(name);
+	}
+}
+
+void SceneCache::writeTransform(Writer& w, const TransformNode* node)
+{
+	map<const TransformNode*, int32_t>::const_iterator t = w.transforms.find(node);
+	if (t != w.transforms.end()) {
+		w.put(t->second);
+		return;
+	}
+	int32_t index = (int32_t)w.transforms.size();
+	w.transforms[node] = index;
+	w.put(index);
+	w.put(node->transform());
+}
+
+TransformNode* SceneCache::readTransform(Reader& r, Scene* scene)
+{
+	int32_t index = r.get<int32_t>();
+	if (index >= 0 && (size_t)index < r.transforms.size())
+		return r.transforms[index];
+	if ((size_t)index != r.transforms.size()) {
+		r.fail();
+		return 0;
+	}
+	// The stored matrix is the whole transform down to the object, so the
+	// node hangs off the root; multiplying by the root's identity is exact.
+	rmat4 xform = r.get<rmat4>();
+	if (!r.good()) return 0;
+	TransformNode* node = scene->transformRoot.createChild(xform);
+	r.transforms.push_back(node);
+	return node;
+}
+
+void SceneCache::writeMesh(Writer& w, const shared_ptr<TrimeshData>& mesh)
+{
+	map<const TrimeshData*, int32_t>::const_iterator m = w.meshes.find(mesh.get());
+	if (m != w.meshes.end()) {
+		w.put(m->second);
+		return;
+	}
+	int32_t index = (int32_t)w.meshes.size();
+	w.meshes[mesh.get()] = index;
+	w.put(index);
+
+	const TrimeshData& data = *mesh;
+	w.putVector(data.vertices);
+	w.putVector(data.normals);
+	w.put<uint32_t>((uint32_t)data.materials.size());
+	for (size_t k = 0; k < data.materials.size(); k++)
+		writeMaterial(w, *data.materials[k]);
+	w.putVector(data.indices);
+	const TrimeshFaceArrays& faces = data.faces;
+	for (int k = 0; k < 3; k++) {
+		w.putVector(faces.v0[k]);
+		w.putVector(faces.e1[k]);
+		w.putVector(faces.e2[k]);
+		w.putVector(faces.n[k]);
+	}
+	w.putVector(faces.dist);
+	w.putVector(data.bvh.getNodes());
+	w.putVector(data.bvh.order());
+	w.put<uint8_t>(data.vertNorms);
+}
+
+shared_ptr<TrimeshData> SceneCache::readMesh(Reader& r, Scene* scene)
+{
+	int32_t index = r.get<int32_t>();
+	if (index >= 0 && (size_t)index < r.meshes.size())
+		return r.meshes[index];
+	if ((size_t)index != r.meshes.size()) {
+		r.fail();
+		return shared_ptr<TrimeshData>();
+	}
+
+	shared_ptr<TrimeshData> mesh(new TrimeshData);
+	TrimeshData& data = *mesh;
+	r.getVector(data.vertices);
+	r.getVector(data.normals);
+	uint32_t materials = r.get<uint32_t>();
+	for (uint32_t k = 0; k < materials && r.good(); k++)
+		data.materials.push_back(readMaterial(r, scene));
+	r.getVector(data.indices);
+	TrimeshFaceArrays& faces = data.faces;
+	for (int k = 0; k < 3; k++) {
+		r.getVector(faces.v0[k]);
+		r.getVector(faces.e1[k]);
+		r.getVector(faces.e2[k]);
+		r.getVector(faces.n[k]);
+	}
+	r.getVector(faces.dist);
+	vector<BVH::Node> nodes;
+	vector<int> order;
+	r.getVector(nodes);
+	r.getVector(order);
+	data.bvh.restore(nodes, order);
+	data.vertNorms = r.get<uint8_t>() != 0;
+
+	// The hashes only say the cache is current; check that the arrays fit
+	// together before intersection code indexes them unchecked.
+	size_t count = faces.dist.size();
+	bool fits = data.indices.size() == 3 * count &&
+		data.bvh.valid(count) &&
+		(data.normals.empty() || data.normals.size() == data.vertices.size()) &&
+		(data.materials.empty() || data.materials.size() == data.vertices.size());
+	for (int k = 0; k < 3 && fits; k++)
+		fits = faces.v0[k].size() == count && faces.e1[k].size() == count &&
+			faces.e2[k].size() == count && faces.n[k].size() == count;
+	for (size_t k = 0; k < data.indices.size() && fits; k++)
+		fits = data.indices[k] >= 0 && (size_t)data.indices[k] < data.vertices.size();
+	if (!r.good() || !fits) {
+		r.fail();
+		return shared_ptr<TrimeshData>();
+	}
+	r.meshes.push_back(mesh);
+	return mesh;
+}
@@ -0,0 +1,78 @@
+//
+// sceneCache.h
+//
+// A compiled form of a scene file, kept next to it so that later runs can
+// load the scene without parsing it or building its mesh BVHs.
+//
+
+#ifndef __SCENECACHE_H__
+#define __SCENECACHE_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+class Scene;
+class ThreadPool;
+class Material;
+class MaterialParameter;
+class TransformNode;
+struct TrimeshData;
+
+// The cache holds the camera, the ambient light, the lights and, for each
+// object, its transform, material and shape parameters.  Trimeshes are
+// stored once per shared mesh, complete with the face arrays and the BVH
+// in leaf order, and their large arrays are copied straight out of the
+// memory mapped file.  Texture maps are stored by name and loaded again.
+//
+// Everything is written in the build's own byte order and precision, and
+// the file is tagged with a format version, sizeof(real), a hash of the
+// scene file and a hash of each mesh file the scene read, so a cache left
+// by another build or by an edited scene is simply ignored.  The top-level
+// BVH is not stored; it is built over whole objects and cheap to redo.
+class SceneCache {
+public:
+	// Hash n bytes with FNV-1a, taking eight bytes at a time.
+	static uint64_t hash(const char* data, size_t n);
+
+	// The name of the cache for a scene file.
+	static std::string pathFor(const std::string& sceneFile);
+
+	// Save scene to path.  sourceHash is the hash of the scene file and
+	// dependencies are the other files it was built from; basePath is the
+	// scene file's directory, which file names under it are stored relative
+	// to.  The cache is written to a temporary file and renamed into place,
+	// so a reader never sees half of one.  Returns false if the scene holds
+	// something the cache cannot store or the file cannot be written.
+	static bool write(const std::string& path, const std::string& basePath,
+		const Scene& scene, uint64_t sourceHash,
+		const std::vector<std::string>& dependencies);
+
+	// Load the scene saved in path, or return 0 if there is no usable
+	// cache: it is missing, damaged, from another build, or sourceHash or
+	// one of the dependencies no longer matches.  Texture maps are loaded
+	// through Scene::getTexture(), on pool if it is given, and may throw
+	// TextureMapException.
+	static Scene* read(const std::string& path, const std::string& basePath,
+		uint64_t sourceHash, ThreadPool* pool = 0);
+
+private:
+	class Writer;
+	class Reader;
+
+	static bool writeScene(Writer& w, const Scene& scene);
+	static void writeMaterial(Writer& w, const Material& m);
+	static void writeParameter(Writer& w, const MaterialParameter& p);
+	static void writeTransform(Writer& w, const TransformNode* node);
+	static void writeMesh(Writer& w, const std::shared_ptr<TrimeshData>& mesh);
+
+	static bool readScene(Reader& r, Scene* scene);
+	static Material* readMaterial(Reader& r, Scene* scene);
+	static void readParameter(Reader& r, Scene* scene, MaterialParameter& p);
+	static TransformNode* readTransform(Reader& r, Scene* scene);
+	static std::shared_ptr<TrimeshData> readMesh(Reader& r, Scene* scene);
+};
+
+#endif // __SCENECACHE_H__
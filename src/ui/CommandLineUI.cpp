@@ -10,24 +10,29 @@ extern int getopt(int argc, char *const *argv, const char *optstring);
 #endif
 
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
 
 #include "CommandLineUI.h"
 #include "../fileio/bitmap.h"
 
 #include "../RayTracer.h"
+#include "../scene/light.h"
+#include "../SceneObjects/triangle.h"
 
 using namespace std;
 
 // The command line UI simply parses out all the arguments off
 // the command line and stores them locally.
 CommandLineUI::CommandLineUI( int argc, char** argv )
-	: TraceUI()
+	: TraceUI(), refName(0), diffTolerance(2)
 {
 	int i;
 
 	progName=argv[0];
 
-	while( (i = getopt( argc, argv, "tr:w:h:" )) != EOF )
+	while( (i = getopt( argc, argv, "tr:w:h:a:A:b:T:p:W:d:D:C" )) != EOF )
 	{
 		switch( i )
 		{
@@ -38,6 +43,43 @@ CommandLineUI::CommandLineUI( int argc, char** argv )
 			case 'w':
 				m_nSize = atoi( optarg );
 				break;
+
+			case 'a':
+				m_antiAlias = true;
+				m_nSuperSamples = atoi( optarg );
+				break;
+
+			case 'A':
+				m_nAaThreshold = atoi( optarg );
+				break;
+
+			case 'b':
+				m_nBlockSize = atoi( optarg );
+				break;
+
+			case 'T':
+				m_nThreshold = atoi( optarg );
+				break;
+
+			case 'p':
+				m_nPacketSize = atoi( optarg );
+				break;
+
+			case 'W':
+				m_nWeightThreshold = atoi( optarg );
+				break;
+
+			case 'd':
+				refName = optarg;
+				break;
+
+			case 'D':
+				diffTolerance = atoi( optarg );
+				break;
+
+			case 'C':
+				m_sceneCache = false;
+				break;
 			default:
 			// Oops; unknown argument
 			std::cerr << "Invalid argument: '" << i << "'." << std::endl;
@@ -75,8 +117,14 @@ int CommandLineUI::run()
 		//	for( int i = 0; i < width; ++i )
 		//		raytracer->tracePixel(i,j,0);
                 raytracer->setThreads(8);
-                raytracer->traceImage(width, height, 4, 0.001);
-                while(!raytracer->checkRender());
+                resetShadowCacheStats();
+                raytracer->traceImage(width, height, getBlockSize(), getThreshold());
+                raytracer->waitRender();
+                if( aaSwitch() )
+                {
+                    raytracer->aaImage( getSuperSamples(), getAaThreshold() );
+                    raytracer->waitRender();
+                }
 
 		end=clock();
 
@@ -87,11 +135,21 @@ int CommandLineUI::run()
 
 		if (buf)
 			writeBMP(imgName, width, height, buf);
+		bool same = !refName || (buf && compareImage(buf, width, height));
 
 		double t=(double)(end-start)/CLOCKS_PER_SEC;
-//		int totalRays = TraceUI::resetCount();
-//		std::cout << "total time = " << t << " seconds, rays traced = " << totalRays << std::endl;
-        return 0;
+		std::cout << "total time = " << t << " seconds, rays traced = " << TraceUI::getCount()
+			<< " (visibility " << TraceUI::getCount(ray::VISIBILITY)
+			<< ", reflection " << TraceUI::getCount(ray::REFLECTION)
+			<< ", refraction " << TraceUI::getCount(ray::REFRACTION)
+			<< ", shadow " << TraceUI::getCount(ray::SHADOW)
+			<< "), intersection tests: " << TraceUI::getTests()
+			<< " (" << triangleKernelName() << " triangle kernel)" << std::endl;
+		ShadowCacheStats shadows = getShadowCacheStats();
+		std::cout << "shadow cache: " << shadows.hits << " hits, "
+			<< shadows.misses << " misses, " << shadows.unblocked << " unblocked" << std::endl;
+
+        return same ? 0 : 2;
 	}
 	else
 	{
@@ -100,6 +158,48 @@ int CommandLineUI::run()
 	}
 }
 
+bool CommandLineUI::compareImage( const unsigned char* buf, int width, int height )
+{
+	int refWidth, refHeight;
+	unsigned char* ref = readBMP( refName, refWidth, refHeight );
+	if( !ref )
+	{
+		std::cerr << "Unable to read reference image '" << refName << "'" << std::endl;
+		return false;
+	}
+	if( refWidth != width || refHeight != height )
+	{
+		std::cerr << "Reference image is " << refWidth << "x" << refHeight
+			<< ", rendered image is " << width << "x" << height << std::endl;
+		delete [] ref;
+		return false;
+	}
+
+	int maxDiff = 0;
+	long differing = 0;
+	double sumSq = 0.0;
+	for( int k = 0; k < width * height; k++ )
+	{
+		int pixelDiff = 0;
+		for( int c = 0; c < 3; c++ )
+		{
+			int diff = abs( (int)buf[3 * k + c] - (int)ref[3 * k + c] );
+			pixelDiff = max( pixelDiff, diff );
+			sumSq += (double)diff * diff;
+		}
+		maxDiff = max( maxDiff, pixelDiff );
+		if( pixelDiff > diffTolerance )
+			differing++;
+	}
+	delete [] ref;
+
+	double rms = sqrt( sumSq / (3.0 * width * height) );
+	std::cout << "image diff against " << refName << ": max " << maxDiff << ", rms " << rms
+		<< ", " << differing << " of " << width * height << " pixels off by more than "
+		<< diffTolerance << std::endl;
+	return differing == 0;
+}
+
 void CommandLineUI::alert( const string& msg )
 {
 	std::cerr << msg << std::endl;
@@ -110,4 +210,13 @@ void CommandLineUI::usage()
 	std::cerr << "usage: " << progName << " [options] [input.ray output.bmp]" << std::endl;
 	std::cerr << "  -r <#>      set recursion level (default " << m_nDepth << ")" << std::endl; 
 	std::cerr << "  -w <#>      set output image width (default " << m_nSize << ")" << std::endl;
+	std::cerr << "  -a <#>      anti-alias with up to (#+1)^2 samples per pixel (default off)" << std::endl;
+	std::cerr << "  -A <#>      anti-aliasing threshold x 0.001 (default " << m_nAaThreshold << ")" << std::endl;
+	std::cerr << "  -b <#>      draft block size (default " << m_nBlockSize << ")" << std::endl;
+	std::cerr << "  -T <#>      draft interpolation threshold x 0.001, 0 traces every pixel (default " << m_nThreshold << ")" << std::endl;
+	std::cerr << "  -p <#>      primary rays traced as a packet: 1, 4, 8 or 16 (default " << m_nPacketSize << ")" << std::endl;
+	std::cerr << "  -W <#>      skip reflected and refracted rays weighing no more than # x 0.001 (default " << m_nWeightThreshold << ")" << std::endl;
+	std::cerr << "  -d <file>   compare the image against a reference .bmp; exit status 2 if they differ" << std::endl;
+	std::cerr << "  -D <#>      levels (0-255) a channel may differ from the reference (default " << diffTolerance << ")" << std::endl;
+	std::cerr << "  -C          neither use nor write the compiled scene cache (input.ray.cache)" << std::endl;
 }
@@ -20,9 +20,16 @@ public:
 private:
 	void		usage();
 
+	// Compare the rendered image against the reference image refName,
+	// e.g. a float build's output against the double build's.  Returns
+	// true if no channel differs by more than diffTolerance.
+	bool		compareImage( const unsigned char* buf, int width, int height );
+
 	char*	rayName;
 	char*	imgName;
 	char*	progName;
+	char*	refName;
+	int		diffTolerance;
 };
 
 #endif
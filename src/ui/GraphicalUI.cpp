@@ -18,6 +18,7 @@
 
 #include "GraphicalUI.h"
 #include "../RayTracer.h"
+#include "../scene/light.h"
 
 #define MAX_INTERVAL 500
 
@@ -189,6 +190,11 @@ void GraphicalUI::cb_filterSlides(Fl_Widget* o, void* v)
 	pUI->m_nFilterWidth=int( ((Fl_Slider *)o)->value() ) ;
 }
 
+void GraphicalUI::cb_weightThresholdSlides(Fl_Widget* o, void* v)
+{
+	((GraphicalUI*)(o->user_data()))->m_nWeightThreshold=int( ((Fl_Slider *)o)->value() ) ;
+}
+
 void GraphicalUI::cb_debuggingDisplayCheckButton(Fl_Widget* o, void* v)
 {
 	pUI=(GraphicalUI*)(o->user_data());
@@ -285,12 +291,13 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 		auto t_start = std::chrono::high_resolution_clock::now();
 		auto t_now = t_start;
 		auto t_elapsed = std::chrono::duration<double, std::ratio<1>>(t_now - t_start).count();
+		resetShadowCacheStats();
 		pUI->raytracer->traceImage(width, height, pUI->getBlockSize(), pUI->getThreshold());
 		clock_t intervalMS = pUI->refreshInterval * 100;
-		while (!pUI->raytracer->checkRender())
+		// wake up to check for input and refresh the view every so often
+		// while tracing, or as soon as the trace is done
+		while (!pUI->raytracer->waitRender((int)std::min(intervalMS, (clock_t)MAX_INTERVAL)))
 		{
-			// check for input and refresh view every so often while tracing
-			std::this_thread::sleep_for(std::chrono::milliseconds(std::min(intervalMS, (clock_t)MAX_INTERVAL)));
 			now = clock();
 			traceTime = now - startTime;
 			t_now = std::chrono::high_resolution_clock::now();
@@ -320,10 +327,8 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 			auto t_total = std::chrono::duration<double, std::ratio<1>>(t_now - t_start).count();
 			aaStart = now = prev = clock();
 			int aaPixels = pUI->raytracer->aaImage(pUI->getSuperSamples(), pUI->getAaThreshold());
-			while (!pUI->raytracer->checkRender())
+			while (!pUI->raytracer->waitRender((int)std::min(intervalMS, (clock_t)MAX_INTERVAL)))
 			{
-				// check for input and refresh view every so often while tracing
-				std::this_thread::sleep_for(std::chrono::milliseconds(std::min(intervalMS, (clock_t)MAX_INTERVAL)));
 				now = clock();
 				aaTime = now - aaStart;
 				t_now = std::chrono::high_resolution_clock::now();
@@ -444,10 +449,10 @@ Fl_Menu_Item GraphicalUI::menuitems[] = {
 void GraphicalUI::stopTracing()
 {
 	stopTrace = true;
-	pUI->raytracer->stopTrace = true;
+	pUI->raytracer->requestStop();
 
-	// Wait for the trace to finish (simple synchronization)
-	while(!pUI->raytracer->checkRender()) Fl::wait();
+	// Wait for the render jobs to notice and finish their current tiles
+	pUI->raytracer->waitRender();
 //	while(!doneTrace)	Fl::wait();
 }
 
@@ -455,7 +460,7 @@ GraphicalUI::GraphicalUI() : refreshInterval(10) {
 	// init.
 	m_threads = std::max(std::thread::hardware_concurrency(), (unsigned) 1);
 
-	m_mainWindow = new Fl_Window(100, 40, 450, 459, "Ray <Not Loaded>");
+	m_mainWindow = new Fl_Window(100, 40, 450, 484, "Ray <Not Loaded>");
 	m_mainWindow->user_data((void*)(this));	// record self to be used by static callback functions
 	// install menu bar
 	m_menubar = new Fl_Menu_Bar(0, 0, 440, 25);
@@ -663,6 +668,19 @@ GraphicalUI::GraphicalUI() : refreshInterval(10) {
 	m_debuggingDisplayCheckButton->callback(cb_debuggingDisplayCheckButton);
 	m_debuggingDisplayCheckButton->value(m_displayDebuggingInfo);
 
+	// install ray weight threshold slider
+	m_weightSlider = new Fl_Value_Slider(10, 449, 180, 20, "Ray Weight Threshold (x 0.001)");
+	m_weightSlider->user_data((void*)(this));	// record self to be used by static callback functions
+	m_weightSlider->type(FL_HOR_NICE_SLIDER);
+	m_weightSlider->labelfont(FL_COURIER);
+	m_weightSlider->labelsize(12);
+	m_weightSlider->minimum(0);
+	m_weightSlider->maximum(100);
+	m_weightSlider->step(1);
+	m_weightSlider->value(m_nWeightThreshold);
+	m_weightSlider->align(FL_ALIGN_RIGHT);
+	m_weightSlider->callback(cb_weightThresholdSlides);
+
 	m_mainWindow->callback(cb_exit2);
 	m_mainWindow->when(FL_HIDE);
 	m_mainWindow->end();
@@ -44,6 +44,7 @@ public:
 	Fl_Slider*			m_treeDepthSlider;
 	Fl_Slider*			m_leafSizeSlider;
 	Fl_Slider*			m_filterSlider;
+	Fl_Slider*			m_weightSlider;
 
 	Fl_Check_Button*	m_debuggingDisplayCheckButton;
 	Fl_Check_Button*	m_aaCheckButton;
@@ -100,6 +101,7 @@ private:
 	static void cb_kdTreeDepthSlides(Fl_Widget* o, void* v);
 	static void cb_kdLeafSizeSlides(Fl_Widget* o, void* v);
 	static void cb_filterSlides(Fl_Widget* o, void* v);
+	static void cb_weightThresholdSlides(Fl_Widget* o, void* v);
 
 	static void cb_render(Fl_Widget* o, void* v);
 	static void cb_stop(Fl_Widget* o, void* v);
@@ -13,6 +13,7 @@
 //#include <math.h>
 
 #include <string>
+#include <atomic>
 //#include "../RayTracer.h"
 #define MAX_THREADS 32
 
@@ -23,10 +24,10 @@ class RayTracer;
 class TraceUI {
 public:
 	TraceUI()
-		: m_nDepth(0), m_nSize(512), m_nBlockSize(4), m_nThreshold(0), m_nSuperSamples(3), m_nAaThreshold(100), m_nTreeDepth(15), m_nLeafSize(10), m_nFilterWidth(1),
-		m_displayDebuggingInfo(false), m_antiAlias(false), m_kdTree(true), m_shadows(true), m_smoothshade(true), m_usingCubeMap(false), m_backface(true),
-		raytracer(0)
-	{ for (unsigned int i = 0; i < MAX_THREADS; i++) rayCount[i] = 0; }
+		: raytracer(0),
+		m_nSize(512), m_nDepth(0), m_nThreshold(0), m_nBlockSize(4), m_nSuperSamples(3), m_nAaThreshold(100), m_nTreeDepth(15), m_nLeafSize(10), m_nFilterWidth(1), m_nPacketSize(16), m_nWeightThreshold(2),
+		m_displayDebuggingInfo(false), m_antiAlias(false), m_kdTree(true), m_shadows(true), m_smoothshade(true), m_backface(true), m_sceneCache(true), m_usingCubeMap(false), m_gotCubeMap(false)
+	{ resetCount(); }
 
 	virtual int	run() = 0;
 
@@ -48,38 +49,59 @@ public:
 	int	getMaxDepth() const { return m_nTreeDepth; }
 	int	getLeafSize() const { return m_nLeafSize; }
 	int	getFilterWidth() const { return m_nFilterWidth; }
+	int	getPacketSize() const { return m_nPacketSize; }
+	double	getWeightThreshold() const { return (double)m_nWeightThreshold * 0.001; }
 	int	getThreads() const { return m_threads; }
 	bool	aaSwitch() const { return m_antiAlias; }
 	bool	kdSwitch() const { return m_kdTree; }
 	bool	shadowSw() const { return m_shadows; }
 	bool	smShadSw() const { return m_smoothshade; }
 	bool	bkFaceSw() const { return m_backface; }
+	bool	sceneCacheSw() const { return m_sceneCache; }
 	bool	cubeMap() const { return m_usingCubeMap && m_gotCubeMap; }
 
-	// ray counter
-	static void addRays(int number, int ctr) { if (ctr >= 0) rayCount[ctr] += number; }
-	static void addRay(int ctr) { if (ctr >= 0) rayCount[ctr]++; }
-	static int getCount(int ctr) { return ctr < 0 ? -1 : rayCount[ctr]; }
-	static int getCount()
+	// Ray statistics.  Every render job counts into its own slot, the ctr
+	// its rays carry, and the slots are padded to a cache line each so no
+	// two threads ever write to the same line.  Only the owning thread
+	// writes a slot, so a plain load and store is enough to count; they are
+	// atomic so that the totals can be read while rendering.
+	enum { RAY_TYPES = 4 };	// as ray::RayType
+	struct alignas(64) RayStats {
+		std::atomic<long> rays[RAY_TYPES];
+		std::atomic<long> tests;	// ray/object intersection tests
+	};
+
+	static void addRay(int ctr, int type) { if (ctr >= 0 && ctr < MAX_THREADS) bump(rayStats[ctr].rays[type]); }
+	static void addTest(int ctr) { if (ctr >= 0 && ctr < MAX_THREADS) bump(rayStats[ctr].tests); }
+	// rays of one ray::RayType, summed over all slots
+	static long getCount(int type)
+	{
+		long total = 0;
+		for (int i = 0; i < MAX_THREADS; i++) total += rayStats[i].rays[type];
+		return total;
+	}
+	static long getTests()
 	{
-		int total = 0;
-		for (int i = 0; i < m_threads; i++) total += rayCount[i];
+		long total = 0;
+		for (int i = 0; i < MAX_THREADS; i++) total += rayStats[i].tests;
 		return total;
 	}
-	static int resetCount(int ctr)
+	// rays of all types
+	static int getCount()
 	{
-		if (ctr < 0 ) return -1;
-		int temp = rayCount[ctr];
-		rayCount[ctr] = 0;
-		return temp;
+		long total = 0;
+		for (int type = 0; type < RAY_TYPES; type++) total += getCount(type);
+		return (int)total;
 	}
+	// Clear all statistics and return the ray count they held.  Only call
+	// while nothing is being traced.
 	static int resetCount()
 	{
-		int total = 0;
-		for (int i = 0; i < m_threads; i++)
+		int total = getCount();
+		for (int i = 0; i < MAX_THREADS; i++)
 		{
-			total += rayCount[i];
-			rayCount[i] = 0;
+			for (int type = 0; type < RAY_TYPES; type++) rayStats[i].rays[type] = 0;
+			rayStats[i].tests = 0;
 		}
 		return total;
 	}
@@ -99,8 +121,15 @@ protected:
 	int m_nTreeDepth;  // maximum kdTree depth
 	int m_nLeafSize;  // target number of objects per leaf
 	int m_nFilterWidth;  // width of cubemap filter
+	int m_nPacketSize;  // primary rays traced together: 1 (off), 4, 8 or 16
+	int m_nWeightThreshold;  // secondary rays weighing no more than this x 0.001 are not traced
+
+	static RayStats rayStats[MAX_THREADS];
 
-	static int rayCount[MAX_THREADS];	// Ray counter
+	static void bump(std::atomic<long>& counter)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
 
 	// Determines whether or not to show debugging information
 	// for individual rays.  Disabled by default for efficiency
@@ -111,6 +140,7 @@ protected:
 	bool m_shadows;  // compute shadows?
 	bool m_smoothshade;  // turn on/off smoothshading?
 	bool m_backface;  // cull backfaces?
+	bool m_sceneCache;  // read and write compiled scene caches?
 	bool m_usingCubeMap;  // render with cubemap
 	bool m_gotCubeMap;  // cubemap defined
 
@@ -181,8 +181,10 @@ void DebuggingView::resetCamera()
 	const Scene& scene = raytracer->getScene();
 
 	glm::dvec3 maxVec = glm::max( scene.bounds().getMax(), scene.bounds().getMin() );
-	maxVec = glm::max( scene.getCamera().getEye(), maxVec );
-	maxVec = glm::max( scene.getCamera().getEye() + scene.getCamera().getLook(), maxVec );
+	glm::dvec3 eye = scene.getCamera().getEye();
+	glm::dvec3 look = scene.getCamera().getLook();
+	maxVec = glm::max( eye, maxVec );
+	maxVec = glm::max( eye + look, maxVec );
 	maxDist = max( max( maxVec[0], maxVec[1] ), maxVec[2] );
 
 	m_camera->setDolly( (GLfloat)maxDist );
@@ -478,7 +480,8 @@ void DebuggingView::drawRays()
 		}
 		glm::dvec3 p = rayItr->first->getPosition();
 		glm::dvec3 d = rayItr->first->getDirection();
-		glm::dvec3 isectPoint = p + rayItr->second->t*d;
+		double t = rayItr->second->t;
+		glm::dvec3 isectPoint = p + t*d;
 
 		glEnable( GL_LINE_STIPPLE );
 		glLineStipple( 1, 0x3333 );
@@ -494,10 +497,11 @@ void DebuggingView::drawRays()
 		{
 			glPushMatrix();
 				glTranslatef( (GLfloat)isectPoint[0], (GLfloat)isectPoint[1], (GLfloat)isectPoint[2] );
+				glm::dvec3 N = rayItr->second->N;
 				glBegin( GL_LINES );
 					glColor4f( 0.5f, 1.0f, 0.5f, 1.0f );
 					glVertex3d( 0.0, 0.0, 0.0 );
-					glVertex3dv(&(rayItr->second->N[0]));
+					glVertex3dv(&N[0]);
 				glEnd();
 			glPopMatrix();
 		}
@@ -537,6 +541,10 @@ void DebuggingView::drawCamera()
 
 	glPushMatrix();
 		const Camera& sceneCamera = raytracer->getScene().getCamera();
+		// in double for the GL calls, whatever the scene's precision
+		const glm::dvec3 look = sceneCamera.getLook();
+		const glm::dvec3 u = sceneCamera.getU();
+		const glm::dvec3 v = sceneCamera.getV();
 		glTranslated( (sceneCamera.getEye())[0],
 					(sceneCamera.getEye())[1],
 					(sceneCamera.getEye())[2] );
@@ -545,26 +553,26 @@ void DebuggingView::drawCamera()
 		// Now need to draw the camera.
 		glBegin( GL_LINES );
 			glVertex3d(0,0,0);
-			glVertex3dv( &(sceneCamera.getLook() 
-				+ 0.5*sceneCamera.getU() 
-				+ 0.5*sceneCamera.getV())[0] );
+			glVertex3dv( &(look 
+				+ 0.5*u 
+				+ 0.5*v)[0] );
 			glVertex3d(0,0,0);
-			glVertex3dv( &(sceneCamera.getLook() 
-				+ 0.5*sceneCamera.getU() 
-				- 0.5*sceneCamera.getV())[0] );
+			glVertex3dv( &(look 
+				+ 0.5*u 
+				- 0.5*v)[0] );
 			glVertex3d(0,0,0);
-			glVertex3dv( &(sceneCamera.getLook() 
-				- 0.5*sceneCamera.getU() 
-				+ 0.5*sceneCamera.getV())[0] );
+			glVertex3dv( &(look 
+				- 0.5*u 
+				+ 0.5*v)[0] );
 			glVertex3d(0,0,0);
-			glVertex3dv( &(sceneCamera.getLook() 
-				- 0.5*sceneCamera.getU() 
-				- 0.5*sceneCamera.getV())[0] );
+			glVertex3dv( &(look 
+				- 0.5*u 
+				- 0.5*v)[0] );
 		glEnd();
 
-		glTranslated( (sceneCamera.getLook())[0],
-					(sceneCamera.getLook())[1],
-					(sceneCamera.getLook())[2] );
+		glTranslated( look[0],
+					look[1],
+					look[2] );
 
 		if( !m_dirty || raytracer->isReady() )
 		{
@@ -581,27 +589,27 @@ void DebuggingView::drawCamera()
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		glBegin( GL_QUADS );
 			glTexCoord2f(0.0, 0.0);
-			glVertex3dv(&(-0.5*sceneCamera.getU() - 0.5*sceneCamera.getV())[0]);
+			glVertex3dv(&(-0.5*u - 0.5*v)[0]);
 
 			glTexCoord2f(0.0, 1.0);
-			glVertex3dv(&(-0.5*sceneCamera.getU() + 0.5*sceneCamera.getV())[0]);
+			glVertex3dv(&(-0.5*u + 0.5*v)[0]);
 
 			glTexCoord2f(1.0, 1.0);
-			glVertex3dv(&(0.5*sceneCamera.getU() + 0.5*sceneCamera.getV())[0]);
+			glVertex3dv(&(0.5*u + 0.5*v)[0]);
 
 			glTexCoord2f(1.0, 0.0);
-			glVertex3dv(&(0.5*sceneCamera.getU() - 0.5*sceneCamera.getV())[0]);
+			glVertex3dv(&(0.5*u - 0.5*v)[0]);
 		glEnd();
 		glDisable(GL_TEXTURE_2D);
 		glDisable(GL_BLEND);
 
 		glColor4f( 1.0f, 1.0f, 1.0f, 1.0f );
 		glBegin( GL_LINE_STRIP );
-			glVertex3dv(&(-0.51*sceneCamera.getU() - 0.51*sceneCamera.getV())[0]);
-			glVertex3dv(&(-0.51*sceneCamera.getU() + 0.51*sceneCamera.getV())[0]);
-			glVertex3dv(&( 0.51*sceneCamera.getU() + 0.51*sceneCamera.getV())[0]);
-			glVertex3dv(&( 0.51*sceneCamera.getU() - 0.51*sceneCamera.getV())[0]);
-			glVertex3dv(&(-0.51*sceneCamera.getU() - 0.51*sceneCamera.getV())[0]);
+			glVertex3dv(&(-0.51*u - 0.51*v)[0]);
+			glVertex3dv(&(-0.51*u + 0.51*v)[0]);
+			glVertex3dv(&( 0.51*u + 0.51*v)[0]);
+			glVertex3dv(&( 0.51*u - 0.51*v)[0]);
+			glVertex3dv(&(-0.51*u - 0.51*v)[0]);
 		glEnd();
 
 
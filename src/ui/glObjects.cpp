@@ -19,6 +19,10 @@ using namespace std;
 
 const double pi = 3.1415926535897932384626433832795028841971693993751058209749445923078164062862;
 
+// Scene vectors are in the renderer's precision; GL gets doubles either way.
+static void glVertexReal( const rvec3& v ) { glVertex3d( v[0], v[1], v[2] ); }
+static void glNormalReal( const rvec3& n ) { glNormal3d( n[0], n[1], n[2] ); }
+
 void Scene::glDraw(int quality, bool actualMaterials, bool actualTextures) const
 {
 	typedef vector<Geometry*>::const_iterator iter;
@@ -348,6 +352,10 @@ void Trimesh::glDrawLocal(int quality, bool actualMaterials, bool actualTextures
 		d = &displayListWithoutMaterials;
 	int& displayList = *d;
 
+	const Vertices& vertices = mesh->vertices;
+	const Normals& normals = mesh->normals;
+	const Materials& materials = mesh->materials;
+
 	// We'll try to buy some time back by using display lists.
 	if( displayList == 0 )
 	{
@@ -355,43 +363,44 @@ void Trimesh::glDrawLocal(int quality, bool actualMaterials, bool actualTextures
 		glNewList( displayList, GL_COMPILE );
 
 		glBegin( GL_TRIANGLES );
-		for( Faces::const_iterator itr = faces.begin(); itr != faces.end(); ++itr )
+		for( int f = 0; f < mesh->faceCount(); ++f )
 		{
-			const int vert1 = (*(*itr))[0];
-			const int vert2 = (*(*itr))[1];
-			const int vert3 = (*(*itr))[2];
+			const int* ids = mesh->face( f );
+			const int vert1 = ids[0];
+			const int vert2 = ids[1];
+			const int vert3 = ids[2];
 
 			if( normals.empty() )
 			{
-				const glm::dvec3& a = vertices[vert1];
-				const glm::dvec3& b = vertices[vert2];
-				const glm::dvec3& c = vertices[vert3];
+				const rvec3& a = vertices[vert1];
+				const rvec3& b = vertices[vert2];
+				const rvec3& c = vertices[vert3];
 
-				glm::dvec3 cv= glm::cross(b - a, c - a);
+				rvec3 cv= glm::cross(b - a, c - a);
 
 				// there exists some bad triangles such that two vertices coincide
 				// check this before normalize
 				if (glm::length(cv) > 0)
-					glNormal3dv( &cv[0] );
+					glNormalReal( cv );
 			}
 
 			if( ! normals.empty() )
-				glNormal3dv( &normals[vert1][0] );
+				glNormalReal( normals[vert1] );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert1], *itr );
-			glVertex3dv( &vertices[vert1][0] );
+				setGLMaterial( *materials[vert1], this );
+			glVertexReal( vertices[vert1] );
 
 			if( ! normals.empty() )
-				glNormal3dv( &normals[vert2][0] );
+				glNormalReal( normals[vert2] );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert2], *itr );
-			glVertex3dv( &vertices[vert2][0] );
+				setGLMaterial( *materials[vert2], this );
+			glVertexReal( vertices[vert2] );
 
 			if( ! normals.empty() )
-				glNormal3dv( &normals[vert3][0] );
+				glNormalReal( normals[vert3] );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert3], *itr );
-			glVertex3dv( &vertices[vert3][0] );
+				setGLMaterial( *materials[vert3], this );
+			glVertexReal( vertices[vert3] );
 		}
 		glEnd();
 
@@ -555,8 +564,10 @@ void DirectionalLight::glDraw() const
 		// We essentially want to find the spherical bounding volume for
 		// the scene so we can put our directional lights just outside it.
 		glm::dvec3 maxVec = glm::max( scene->bounds().getMax(), scene->bounds().getMin() );
-		maxVec = glm::max( scene->getCamera().getEye(), maxVec );
-		maxVec = glm::max( scene->getCamera().getEye() + scene->getCamera().getLook(), maxVec );
+		glm::dvec3 eye = scene->getCamera().getEye();
+		glm::dvec3 look = scene->getCamera().getLook();
+		maxVec = glm::max( eye, maxVec );
+		maxVec = glm::max( eye + look, maxVec );
 		maxDist = max( max( maxVec[0], maxVec[1] ), maxVec[2] );
 
 		glm::dvec3 uAxis = glm::normalize(orientation);